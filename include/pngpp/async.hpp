@@ -5,9 +5,16 @@
 #ifndef PNGPP_ASYNC_HPP__
 #define PNGPP_ASYNC_HPP__
 
+// stdc++
+#include <memory>
+#include <utility>
+
 // boost
 #include <boost/thread/future.hpp>
 
+// tbb
+#include <tbb/task_arena.h>
+
 /**************************************************************************************************/
 
 namespace pngpp {
@@ -15,8 +22,108 @@ namespace pngpp {
 /**************************************************************************************************/
 
 using boost::future;
-using boost::async;
 using boost::make_ready_future;
+using boost::promise;
+
+/**************************************************************************************************/
+// The arena every asynchronous task runs in. Parallel algorithms started by those tasks run in it
+// as well, so saves, dumps and encode trials all share TBB's one pool of threads (one per core)
+// rather than each starting threads of their own.
+tbb::task_arena& executor();
+
+// blocks until every task queued by async() or then() has finished. Nothing else waits on tasks
+// whose futures are dropped, so main() calls this before it returns.
+void wait_for_tasks();
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/**************************************************************************************************/
+// the count wait_for_tasks() waits on
+void begin_task();
+void end_task();
+
+// queues f() in executor(); the task must have been counted with begin_task().
+template <typename F>
+void enqueue(F f) {
+    executor().enqueue([_f = std::move(f)]() {
+        _f();
+
+        end_task();
+    });
+}
+
+/**************************************************************************************************/
+
+template <typename R, typename F>
+void fulfill(promise<R>& p, const F& f) {
+    p.set_value(f());
+}
+
+template <typename F>
+void fulfill(promise<void>& p, const F& f) {
+    f();
+
+    p.set_value();
+}
+
+/**************************************************************************************************/
+
+} // namespace detail
+
+/**************************************************************************************************/
+// Runs f() in executor(), and returns a future for its result (or exception.) A task must never
+// wait on the future of another: the thread it occupies could be the one the other needs. Chain
+// the work with then() instead.
+template <typename F>
+auto async(F f) -> future<decltype(f())> {
+    typedef decltype(f()) result_type;
+
+    auto p(std::make_shared<promise<result_type>>());
+    auto result(p->get_future());
+
+    detail::begin_task();
+
+    detail::enqueue([p, _f = std::move(f)]() {
+        try {
+            detail::fulfill(*p, _f);
+        } catch (...) {
+            p->set_exception(boost::current_exception());
+        }
+    });
+
+    return result;
+}
+
+/**************************************************************************************************/
+// Runs f(x) in executor() once x is ready, and returns a future for its result. f receives the
+// ready future, so x.get() inside it does not block (and rethrows x's exception, if any.)
+template <typename T, typename F>
+auto then(future<T> x, F f) -> future<decltype(f(std::move(x)))> {
+    typedef decltype(f(std::move(x))) result_type;
+
+    auto p(std::make_shared<promise<result_type>>());
+    auto result(p->get_future());
+
+    // counted from now, so that wait_for_tasks() also covers work whose input is not ready yet.
+    // The continuation only queues the task, so it is cheap enough to run wherever x is readied.
+    detail::begin_task();
+
+    x.then(boost::launch::sync, [p, _f = std::move(f)](future<T> ready) {
+        auto shared(std::make_shared<future<T>>(std::move(ready)));
+
+        detail::enqueue([p, _f, shared]() {
+            try {
+                detail::fulfill(*p, [&]() { return _f(std::move(*shared)); });
+            } catch (...) {
+                p->set_exception(boost::current_exception());
+            }
+        });
+    });
+
+    return result;
+}
 
 /**************************************************************************************************/
 
@@ -84,6 +84,27 @@ public:
         return data() + size();
     }
 
+    // gives back any memory past the first `size` bytes; the contents up to there are kept.
+    void truncate(std::size_t size) {
+        if (size >= _size)
+            return;
+
+        if (size == 0) {
+            _buffer.reset();
+            _size = 0;
+            return;
+        }
+
+        void* shrunk(std::realloc(_buffer.get(), size));
+
+        if (!shrunk)
+            return;
+
+        _buffer.release();
+        _buffer.reset(shrunk);
+        _size = size;
+    }
+
     // returns true iff reallocation happened
     bool resize(std::size_t size) {
         if (size <= _size) {
@@ -157,7 +178,31 @@ public:
         return std::move(_buffer);
     }
 
-    void write(void* buffer, std::size_t size) {
+    // like move_buffer, but the result is trimmed to what was actually written.
+    buffer_t release() {
+        _buffer.truncate(_pos);
+        return move_buffer();
+    }
+
+    // makes room for `size` bytes in all (written or not), so writes up to there never grow it.
+    void reserve(std::size_t size) {
+        if (size <= capacity())
+            return;
+
+        buffer_t grown(size);
+
+        if (_pos)
+            std::memcpy(grown.data(), data(), _pos);
+
+        std::swap(_buffer, grown);
+    }
+
+    // forgets what was written, but keeps the memory for the next use.
+    void clear() {
+        _pos = 0;
+    }
+
+    void write(const void* buffer, std::size_t size) {
         std::size_t needed(_pos + size);
 
         if (needed > capacity())
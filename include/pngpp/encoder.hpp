@@ -0,0 +1,84 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_ENCODER_HPP__
+#define PNGPP_ENCODER_HPP__
+
+// stdc++
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// zlib
+#include <zlib.h>
+
+// application
+#include <pngpp/buffer.hpp>
+#include <pngpp/image.hpp>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+// The encoder splits PNG writing into its two expensive stages so that a search over many
+// settings can filter the image once per PNG filter and only repeat the deflate stage per zlib
+// setting.
+
+/**************************************************************************************************/
+// Filters every scanline of the image. The result holds, for each row, the filter type byte
+// followed by the filtered row, which is exactly the stream that gets deflated into IDAT.
+// `png_filter` is a mask of PNG_FILTER_* flags; if more than one flag is set the filter is chosen
+// per row by the minimum sum of absolute differences heuristic (as libpng does.)
+buffer_t filter_image(const image_t& image, int png_filter);
+
+// The adaptive filter heuristic's cost of each filter type (PNG_FILTER_VALUE_NONE through
+// PNG_FILTER_VALUE_PAETH) summed over every `row_step`th row of the image. Lower is better.
+std::vector<std::size_t> filter_costs(const image_t& image, std::size_t row_step);
+
+/**************************************************************************************************/
+
+struct deflate_options_t {
+    int _z_compression{Z_BEST_COMPRESSION};
+    int _z_strategy{Z_FILTERED};
+};
+
+// Encode trials draw their output streams from a pool kept per thread, each reserved up front to
+// what the trial could write, so that a search does not allocate and regrow a stream per trial.
+// Streams a search is done with (e.g., the losers) go back with recycle_stream() for the next
+// trial on the same thread to reuse. A pool holds a few MB at most, so streams of large images are
+// freed instead.
+bufferstream_t pooled_stream(std::size_t size);
+void           recycle_stream(bufferstream_t stream);
+
+// Writes a complete PNG (signature, IHDR, PLTE/tRNS if needed, IDAT and IEND) for `image`,
+// deflating the already-`filtered` scanlines into a pooled stream. If the output reaches `budget`
+// bytes the encode is abandoned and an empty stream is returned.
+bufferstream_t encode_filtered(const image_t&                  image,
+                               const buffer_t&                 filtered,
+                               const deflate_options_t&        options,
+                               const std::atomic<std::size_t>& budget);
+
+// Same as encode_filtered, but large inputs are split into strips that are deflated concurrently
+// and joined into a single zlib stream. Each strip's dictionary is primed with the tail of the
+// strip before it, so little compression is lost.
+bufferstream_t encode_filtered_parallel(const image_t&           image,
+                                        const buffer_t&          filtered,
+                                        const deflate_options_t& options);
+
+// Returns how many bytes `size` bytes of filtered scanlines deflate to, without keeping the
+// compressed data. Useful for ranking settings on a sample of the image.
+std::size_t deflated_size(const std::uint8_t*       data,
+                          std::size_t               size,
+                          const deflate_options_t&  options);
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
+
+#endif // PNGPP_ENCODER_HPP__
+
+/**************************************************************************************************/
@@ -5,10 +5,16 @@
 #ifndef PNGPP_FILES_HPP__
 #define PNGPP_FILES_HPP__
 
+// stdc++
+#include <cstdint>
+
 // boost
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
 
+// application
+#include <pngpp/buffer.hpp>
+
 /**************************************************************************************************/
 
 namespace pngpp {
@@ -27,6 +33,31 @@ path_t associated_filename(path_t src, const std::string& new_leaf);
 // takes ("/path/to.png", "extra") and returns "/path/extra_to.png"
 path_t derived_filename(path_t src, const std::string& new_leaf);
 
+/**************************************************************************************************/
+// A read-only view of a file's contents. Regular files are memory mapped (and advised for
+// sequential access) so readers can be served straight from the page cache; anything that cannot
+// be mapped (pipes, empty files, platforms without mmap) is read into memory instead.
+class file_view_t {
+    const std::uint8_t* _data{nullptr};
+    std::size_t         _size{0};
+    bool                _mapped{false};
+    buffer_t            _copy; // backing store when the file could not be mapped
+
+public:
+    explicit file_view_t(const path_t& path);
+    ~file_view_t();
+
+    file_view_t(const file_view_t&) = delete;
+    file_view_t& operator=(const file_view_t&) = delete;
+
+    const std::uint8_t* data() const {
+        return _data;
+    }
+    std::size_t size() const {
+        return _size;
+    }
+};
+
 /**************************************************************************************************/
 
 } // namespace pngpp
@@ -0,0 +1,100 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_HISTOGRAM_HPP__
+#define PNGPP_HISTOGRAM_HPP__
+
+/**************************************************************************************************/
+
+// stdc++
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// application
+#include <pngpp/image.hpp>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+// RGBA packed into 32 bits. Packed values sort the same way rgba_t does.
+inline std::uint32_t pack_rgba(const rgba_t& c) {
+    return (std::uint32_t(c._r) << 24) | (std::uint32_t(c._g) << 16) | (std::uint32_t(c._b) << 8) |
+           c._a;
+}
+
+inline rgba_t unpack_rgba(std::uint32_t x) {
+    return rgba_t{static_cast<std::uint8_t>(x >> 24),
+                  static_cast<std::uint8_t>(x >> 16),
+                  static_cast<std::uint8_t>(x >> 8),
+                  static_cast<std::uint8_t>(x)};
+}
+
+/**************************************************************************************************/
+// Pixel counts per color, kept in a flat open-addressing table keyed on packed RGBA (linear
+// probing over a power-of-two capacity that doubles at half full.) Iteration order is arbitrary;
+// use sorted() when order matters.
+class color_histogram_t {
+    std::vector<std::uint32_t> _keys;
+    std::vector<std::uint64_t> _counts; // 0 marks an empty slot
+    std::size_t                _size{0};
+    std::size_t                _shift{0}; // 32 - log2(capacity)
+
+    std::size_t home(std::uint32_t key) const {
+        return (key * std::uint32_t(0x9e3779b1)) >> _shift;
+    }
+
+    void grow();
+
+public:
+    color_histogram_t();
+
+    auto size() const {
+        return _size;
+    }
+    auto capacity() const {
+        return _keys.size();
+    }
+
+    void add(std::uint32_t key, std::uint64_t count = 1);
+
+    void add(const rgba_t& color, std::uint64_t count = 1) {
+        add(pack_rgba(color), count);
+    }
+
+    // folds another histogram's counts into this one
+    void merge(const color_histogram_t& x);
+
+    // the slot holding `key`, which must be present. Slots are stable until the next add().
+    std::size_t slot(std::uint32_t key) const;
+
+    // (color, count) for every color, in ascending color order
+    std::vector<std::pair<rgba_t, std::uint64_t>> sorted() const;
+
+    // f(packed color, count, slot) for every color
+    template <typename F>
+    void for_each(F f) const {
+        auto count(capacity());
+
+        for (std::size_t i(0); i < count; ++i)
+            if (_counts[i])
+                f(_keys[i], _counts[i], i);
+    }
+};
+
+// The truecolor histogram of an image, built over row ranges in parallel: each worker fills a
+// private table and the tables are merged at the end.
+color_histogram_t color_histogram(const image_t& image);
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
+
+#endif // PNGPP_HISTOGRAM_HPP__
+
+/**************************************************************************************************/
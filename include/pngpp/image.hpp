@@ -8,6 +8,8 @@
 /**************************************************************************************************/
 
 // stdc++
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -28,18 +30,38 @@ typedef std::vector<rgba_t> color_table_t;
 
 /**************************************************************************************************/
 
+// Copies of an image share their pixels until one of them writes: the non-const accessors
+// (data(), begin(), end()) first give the image its own buffer if another shares it. Code that
+// writes from several threads must take its pointer before the work is split up. A use count of
+// one is only a relaxed read, so an acquire fence follows it: a copy dropped on another thread
+// (e.g., by a finished save) released the buffer when its count went down, and the fence orders
+// that thread's last reads before this one's writes.
 class image_t {
-    std::size_t   _width{0};
-    std::size_t   _height{0};
-    std::size_t   _depth{0};
-    std::size_t   _rowbytes{0};
-    int           _color_type{0};
-    buffer_t      _buffer;
-    color_table_t _color_table;
-    bool          _premultiplied{false};
+    std::size_t               _width{0};
+    std::size_t               _height{0};
+    std::size_t               _depth{0};
+    std::size_t               _rowbytes{0};
+    int                       _color_type{0};
+    std::shared_ptr<buffer_t> _buffer;
+    color_table_t             _color_table;
+    bool                      _premultiplied{false};
 
     friend bool operator==(const image_t& x, const image_t& y);
 
+    void unshare() {
+        if (!_buffer)
+            return;
+
+        if (_buffer.use_count() > 1)
+            _buffer = std::make_shared<buffer_t>(*_buffer);
+        else
+            std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    std::size_t size() const {
+        return _buffer ? _buffer->size() : 0;
+    }
+
 public:
     image_t() = default;
 
@@ -49,28 +71,30 @@ public:
             std::size_t rowbytes,
             int         color_type)
         : _width(width), _height(height), _depth(depth), _rowbytes(rowbytes),
-          _color_type(color_type), _buffer(rowbytes * _height) {
+          _color_type(color_type), _buffer(std::make_shared<buffer_t>(rowbytes * _height)) {
         if (_depth != 8)
             throw std::runtime_error("depth " + std::to_string(_depth) + " not supported.");
     }
 
-    auto data() {
-        return _buffer.data();
+    buffer_t::value_type* data() {
+        unshare();
+
+        return _buffer ? _buffer->data() : nullptr;
     }
-    auto data() const {
-        return _buffer.data();
+    const buffer_t::value_type* data() const {
+        return _buffer ? _buffer->data() : nullptr;
     }
     auto begin() {
-        return _buffer.begin();
+        return data();
     }
     auto begin() const {
-        return _buffer.begin();
+        return data();
     }
     auto end() {
-        return _buffer.end();
+        return data() + size();
     }
     auto end() const {
-        return _buffer.end();
+        return data() + size();
     }
 
     auto width() const {
@@ -136,7 +160,8 @@ public:
 
 inline bool operator==(const image_t& x, const image_t& y) {
     return x._width == y._width && x._height == y._height && x._depth == y._depth &&
-           x._rowbytes == y._rowbytes && x._color_type == y._color_type && x._buffer == y._buffer &&
+           x._rowbytes == y._rowbytes && x._color_type == y._color_type &&
+           (x._buffer == y._buffer || std::equal(x.begin(), x.end(), y.begin(), y.end())) &&
            x._color_table == y._color_table;
 }
 
@@ -144,6 +169,12 @@ inline bool operator!=(const image_t& x, const image_t& y) {
     return !(x == y);
 }
 
+/**************************************************************************************************/
+// In-place kernels over `count` interleaved RGBA pixels (e.g., one row of a streamed image.) They
+// use the widest vector unit the CPU has and give the same results as fixmul/fixdiv per channel.
+void premultiply_rgba(std::uint8_t* pixels, std::size_t count);
+void unpremultiply_rgba(std::uint8_t* pixels, std::size_t count);
+
 /**************************************************************************************************/
 // if the image includes an alpha channel, it is premultiplied into it
 image_t premultiply(image_t image);
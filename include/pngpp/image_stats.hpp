@@ -0,0 +1,52 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_IMAGE_STATS_HPP__
+#define PNGPP_IMAGE_STATS_HPP__
+
+/**************************************************************************************************/
+
+// stdc++
+#include <vector>
+
+// application
+#include <pngpp/image.hpp>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+// A cheap summary of an image's content, gathered from a sample of its rows. It is meant to steer
+// encoder settings, not to be exact.
+struct image_stats_t {
+    std::size_t              _unique_colors{0};   // in the sampled rows; saturates at the cap
+    bool                     _uses_alpha{false};  // any pixel (or table entry) not fully opaque
+    double                   _row_correlation{0}; // fraction of bytes equal to the byte above
+    std::vector<std::size_t> _filter_costs;       // per PNG_FILTER_VALUE_*; lower is better
+    std::size_t              _best_filter{0};     // PNG_FILTER_VALUE_* with the lowest cost
+};
+
+image_stats_t compute_image_stats(const image_t& image);
+
+/**************************************************************************************************/
+
+enum class image_class {
+    palette,    // indexed, or few enough colors to be indexed
+    flat,       // graphics: large runs of solid color, often with alpha
+    screenshot, // opaque UI-like content: repeated rows, sharp edges, modest color count
+    photo       // continuous tone
+};
+
+image_class classify(const image_stats_t& stats);
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
+
+#endif // PNGPP_IMAGE_STATS_HPP__
+
+/**************************************************************************************************/
@@ -7,6 +7,7 @@
 
 // stdc++
 #include <fstream>
+#include <memory>
 #include <boost/thread/future.hpp>
 
 // libpng
@@ -17,6 +18,7 @@
 
 // application
 #include <pngpp/async.hpp>
+#include <pngpp/buffer.hpp>
 #include <pngpp/files.hpp>
 #include <pngpp/image.hpp>
 
@@ -28,9 +30,15 @@ namespace pngpp {
 
 image_t read_png(const path_t& path);
 
+// decodes a PNG that is already in memory (e.g., from a cache or a socket.)
+image_t decode_png(const std::uint8_t* data, std::size_t size);
+
 /**************************************************************************************************/
 // "save" connotes "to disk" more than "write" does (which could also be going to memory).
-enum class save_mode { one, mid, max };
+// `halving` searches the same candidates as `max`, but ranks them on growing samples of the image
+// and only fully encodes the few that survive. It is much faster than `max`, at the risk of
+// missing the smallest file by a little.
+enum class save_mode { one, mid, max, halving };
 
 struct save_options_t {
     save_mode _mode{save_mode::one};
@@ -39,11 +47,44 @@ struct save_options_t {
     int       _one_png_filter{PNG_ALL_FILTERS};
 };
 
-// returns the size of the saved file in bytes.
+// Returns the size of the saved file in bytes. Until the save finishes it holds a claim on the
+// save budget (see save_claim_t), so it may block while other saves drain.
 future<std::size_t> save_png(const image_t&        image,
                              const path_t&         path,
                              const save_options_t& options);
 
+// save_png's work, done on the calling thread. Tasks that save call this rather than waiting on
+// save_png (see async().)
+std::size_t save_png_sync(const image_t& image, const path_t& path, const save_options_t& options);
+
+/**************************************************************************************************/
+// Every pending save holds a copy of its image (save_png and dump_image both make one.) A claim
+// reserves that copy's bytes against the save budget until the claim is destroyed. Making one
+// blocks while the bytes already claimed plus its own would exceed the budget. A lone claim always
+// gets through, however large, so an image bigger than the budget is saved on its own. Claims
+// must be made outside executor() tasks: a task blocked on the budget could hold the thread that
+// the claims ahead of it need.
+class save_claim_t {
+    std::size_t _bytes;
+
+public:
+    explicit save_claim_t(const image_t& image);
+    ~save_claim_t();
+
+    save_claim_t(const save_claim_t&) = delete;
+    save_claim_t& operator=(const save_claim_t&) = delete;
+};
+
+// the most image bytes pending saves may hold at once; 256MB by default.
+void set_save_budget(std::size_t bytes);
+
+// blocks until every claim on the save budget has been released, i.e., every save made so far is
+// on disk.
+void flush_saves();
+
+// runs the same search as save_png, but synchronously and into memory instead of to disk.
+buffer_t encode_png(const image_t& image, const save_options_t& options);
+
 /**************************************************************************************************/
 
 } // namespace pngpp
@@ -0,0 +1,40 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_PNG_ERRORS_HPP__
+#define PNGPP_PNG_ERRORS_HPP__
+
+/**************************************************************************************************/
+
+// libpng
+#include <png.h>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/**************************************************************************************************/
+// The error and warning handlers given to every libpng read and write struct. An error throws
+// std::runtime_error out of libpng, so the caller must free its structs as the exception passes.
+// Debug builds echo both to std::cerr.
+void png_fail(png_structp, png_const_charp message);
+void png_warn(png_structp, png_const_charp message);
+
+/**************************************************************************************************/
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
+
+#endif // PNGPP_PNG_ERRORS_HPP__
+
+/**************************************************************************************************/
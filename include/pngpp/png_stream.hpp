@@ -0,0 +1,131 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_PNG_STREAM_HPP__
+#define PNGPP_PNG_STREAM_HPP__
+
+// stdc++
+#include <fstream>
+#include <memory>
+
+// libpng
+#include <png.h>
+
+// application
+#include <pngpp/files.hpp>
+#include <pngpp/image.hpp>
+#include <pngpp/png.hpp>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+// The streaming pair below moves a PNG one row at a time, so images too large to hold in memory
+// (e.g., scans of hundreds of megapixels) can be transformed or recompressed with a working set of
+// a row or two. Rows use the same layout as an image_t's rows.
+
+/**************************************************************************************************/
+// Pulls rows from a PNG file. Interlaced files cannot be streamed and are rejected.
+class png_row_reader_t {
+    std::unique_ptr<file_view_t> _file;
+    const std::uint8_t*          _first{nullptr};
+    const std::uint8_t*          _last{nullptr};
+    png_structp                  _png_struct{nullptr};
+    png_infop                    _png_info{nullptr};
+    std::size_t                  _width{0};
+    std::size_t                  _height{0};
+    std::size_t                  _depth{0};
+    std::size_t                  _rowbytes{0};
+    int                          _color_type{0};
+    color_table_t                _color_table;
+    std::size_t                  _row{0};
+
+    static void read_thunk(png_structp png, png_bytep buffer, png_size_t size);
+
+    void start();
+
+public:
+    explicit png_row_reader_t(const path_t& path);
+    png_row_reader_t(const std::uint8_t* data, std::size_t size);
+    ~png_row_reader_t();
+
+    png_row_reader_t(const png_row_reader_t&) = delete;
+    png_row_reader_t& operator=(const png_row_reader_t&) = delete;
+
+    auto width() const {
+        return _width;
+    }
+    auto height() const {
+        return _height;
+    }
+    auto depth() const {
+        return _depth;
+    }
+    auto rowbytes() const {
+        return _rowbytes;
+    }
+    auto color_type() const {
+        return _color_type;
+    }
+    const auto& color_table() const {
+        return _color_table;
+    }
+
+    // rows not yet read
+    auto remaining() const {
+        return _height - _row;
+    }
+
+    // reads the next row into `row`, which must hold rowbytes() bytes.
+    void read_row(std::uint8_t* row);
+};
+
+/**************************************************************************************************/
+// Pushes rows into a PNG file. The search modes of save_options_t need the whole image, so only
+// its "one" settings are used. The file is complete once height() rows have been written.
+class png_row_writer_t {
+    std::ofstream _output;
+    png_structp   _png_struct{nullptr};
+    png_infop     _png_info{nullptr};
+    std::size_t   _height{0};
+    std::size_t   _row{0};
+
+    static void write_thunk(png_structp png, png_bytep buffer, png_size_t size);
+    static void flush_thunk(png_structp png);
+
+public:
+    png_row_writer_t(const path_t&         path,
+                     std::size_t           width,
+                     std::size_t           height,
+                     std::size_t           depth,
+                     int                   color_type,
+                     const color_table_t&  color_table,
+                     const save_options_t& options);
+    ~png_row_writer_t();
+
+    png_row_writer_t(const png_row_writer_t&) = delete;
+    png_row_writer_t& operator=(const png_row_writer_t&) = delete;
+
+    auto height() const {
+        return _height;
+    }
+
+    // rows not yet written
+    auto remaining() const {
+        return _height - _row;
+    }
+
+    void write_row(const std::uint8_t* row);
+};
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
+
+#endif // PNGPP_PNG_STREAM_HPP__
+
+/**************************************************************************************************/
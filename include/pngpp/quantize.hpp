@@ -0,0 +1,162 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_QUANTIZE_HPP__
+#define PNGPP_QUANTIZE_HPP__
+
+/**************************************************************************************************/
+
+// stdc++
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// application
+#include <pngpp/image.hpp>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+// Colors stored channel by channel (structure of arrays) in 16-bit lanes, the layout the vector
+// nearest-entry kernels work on. A run of colors is searched in blocks of soa_block_k; runs must
+// start on a block boundary, so each is finished with pad().
+constexpr std::size_t soa_block_k{8};
+
+struct nearest_two_t {
+    std::size_t  _index;       // of the nearest color
+    std::int64_t _sq_d;        // squared distance to it
+    std::int64_t _second_sq_d; // squared distance to the runner-up (ties count), or the max
+};
+
+class soa_colors_t {
+    std::vector<std::int16_t>  _rg;    // r and g of each color, interleaved
+    std::vector<std::int16_t>  _ba;    // b and a of each color, interleaved
+    std::vector<std::int32_t>  _bound; // no color from here to the end of its run is nearer
+    std::vector<std::uint32_t> _index; // reported for each color; ties go to the lowest
+
+public:
+    soa_colors_t() = default;
+
+    // a single run holding the table, searched exhaustively
+    explicit soa_colors_t(const color_table_t& table);
+
+    auto size() const {
+        return _index.size();
+    }
+
+    void reserve(std::size_t n);
+
+    // `bound` must not decrease along a run; 0 searches the whole run.
+    void push_back(const rgba_t& c, std::uint32_t index, std::int32_t bound = 0);
+
+    // rounds the size up to a whole block with colors that never win.
+    void pad();
+
+    // the index and squared distance of the color in [first, last) nearest to `c`, or
+    // {0, std::numeric_limits<std::int64_t>::max()} for an empty range.
+    std::pair<std::size_t, std::int64_t> nearest(const rgba_t& c,
+                                                 std::size_t   first,
+                                                 std::size_t   last) const;
+
+    std::pair<std::size_t, std::int64_t> nearest(const rgba_t& c) const {
+        return nearest(c, 0, size());
+    }
+
+    // an exhaustive search of a single run that also reports the runner-up
+    nearest_two_t nearest_two(const rgba_t& c) const;
+};
+
+/**************************************************************************************************/
+// Nearest-entry lookup for a color table. RGBA space is cut into a coarse grid of cells, and each
+// cell lists only the entries that could be nearest to some color inside it, ordered by their
+// distance to the cell. A lookup searches its cell's list and stops as soon as no remaining entry
+// can beat the best so far. The answer is exactly that of a linear scan of the table, ties
+// included (the lowest index wins.)
+class palette_index_t {
+    color_table_t            _table;
+    std::vector<std::size_t> _cells; // cell i's candidates are [_cells[i], _cells[i + 1])
+    soa_colors_t             _candidates;
+
+public:
+    explicit palette_index_t(color_table_t table);
+
+    const color_table_t& table() const {
+        return _table;
+    }
+
+    // the index of the entry nearest to `c` and its squared distance. An empty table yields
+    // {0, std::numeric_limits<std::int64_t>::max()}.
+    std::pair<std::size_t, std::int64_t> nearest(const rgba_t& c) const;
+};
+
+/**************************************************************************************************/
+// grayscale gradient table, used to save quantization error images
+color_table_t make_grad_table();
+
+// the index of the entry nearest to `c` by linear scan, and its (euclidean) distance
+std::pair<std::size_t, double> quantize(const rgba_t& c, const color_table_t& table);
+
+/**************************************************************************************************/
+// first is the image indexed against `color_table`; second is the per-pixel quantization error
+// indexed against make_grad_table().
+typedef std::pair<image_t, image_t> quantization_t;
+
+// the value an error image stores for a pixel `sq_error` (squared distance) from its entry
+inline std::uint8_t quantization_error(std::int64_t sq_error) {
+    return static_cast<std::uint8_t>(std::min<long>(std::lround(std::sqrt(sq_error)), 255));
+}
+
+quantization_t quantize(const image_t& image, color_table_t color_table);
+
+/**************************************************************************************************/
+// A truecolor image collapsed to its unique colors. Quantizing through it solves the nearest entry
+// once per unique color rather than once per pixel, then remaps the pixels, which pays off when
+// the same image is quantized repeatedly (e.g., k-means rounds.)
+class unique_colors_t {
+    std::size_t                _width{0};
+    std::size_t                _height{0};
+    std::size_t                _depth{0};
+    std::vector<rgba_t>        _colors; // ascending, as in a truecolor histogram
+    std::vector<std::size_t>   _counts; // pixels of each color
+    std::vector<std::uint32_t> _pixels; // per pixel, the index of its color in _colors
+
+public:
+    explicit unique_colors_t(const image_t& image);
+
+    auto width() const {
+        return _width;
+    }
+    auto height() const {
+        return _height;
+    }
+    auto depth() const {
+        return _depth;
+    }
+    const auto& colors() const {
+        return _colors;
+    }
+    const auto& counts() const {
+        return _counts;
+    }
+    const auto& pixels() const {
+        return _pixels;
+    }
+};
+
+// same result as quantizing the image `colors` was built from
+quantization_t quantize(const unique_colors_t& colors, color_table_t color_table);
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
+
+#endif // PNGPP_QUANTIZE_HPP__
+
+/**************************************************************************************************/
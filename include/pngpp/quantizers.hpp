@@ -0,0 +1,61 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_QUANTIZERS_HPP__
+#define PNGPP_QUANTIZERS_HPP__
+
+/**************************************************************************************************/
+
+// stdc++
+#include <cstdint>
+#include <vector>
+
+// application
+#include <pngpp/image.hpp>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+// A palette generator: given the unique colors of an image with the pixel count of each, it
+// returns a color table of at most `n` entries (fewer only when the colors run out.) None of them
+// iterate, so they are much cheaper than k-means, and their tables make good k-means seeds.
+typedef color_table_t (*quantizer_t)(const std::vector<rgba_t>&      colors,
+                                     const std::vector<std::size_t>& counts,
+                                     std::size_t                     n);
+
+// Heckbert's median cut: the box of colors with the most squared error is split at the weighted
+// median of its longest side until there are n boxes.
+color_table_t median_cut(const std::vector<rgba_t>&      colors,
+                         const std::vector<std::size_t>& counts,
+                         std::size_t                     n);
+
+// Gervautz and Purgathofer's octree, over RGBA (so each node has 16 children): colors are added
+// to a tree of bit prefixes, and whenever it has more than n leaves the deepest node is folded
+// into a leaf.
+color_table_t octree(const std::vector<rgba_t>&      colors,
+                     const std::vector<std::size_t>& counts,
+                     std::size_t                     n);
+
+// Wu's variance minimization: colors are binned on a grid (5 bits for RGB, 4 for alpha) whose
+// cumulative moments give the error of any box in constant time, and the box with the most error
+// is cut where the two halves lose the most error until there are n boxes. Colors sharing a grid
+// cell are never separated.
+color_table_t wu(const std::vector<rgba_t>&      colors,
+                 const std::vector<std::size_t>& counts,
+                 std::size_t                     n);
+
+// runs `quantizer` over the truecolor histogram of `image`
+color_table_t make_color_table(quantizer_t quantizer, const image_t& image, std::size_t n);
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
+
+#endif // PNGPP_QUANTIZERS_HPP__
+
+/**************************************************************************************************/
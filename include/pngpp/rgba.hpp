@@ -7,6 +7,7 @@
 
 // stdc++
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <algorithm>
@@ -17,19 +18,34 @@ namespace pngpp {
 
 /**************************************************************************************************/
 
-double itof(std::uint8_t x);
+constexpr double itof(std::uint8_t x) {
+    return x / 255.;
+}
+
 std::uint8_t ftoi(double x);
 
 /**************************************************************************************************/
 // 8-bit fixed point arithmetic. This assumes your 8-bit value represents a
 // floating point value of the range [0..1)
 
-// closed multiplication of two values
-std::uint8_t fixmul(std::uint8_t x, std::uint8_t y);
+// closed multiplication of two values. This is round(x * y / 255) done in integers, which is
+// exactly ftoi(itof(x) * itof(y)).
+constexpr std::uint8_t fixmul(std::uint8_t x, std::uint8_t y) {
+    return static_cast<std::uint8_t>((x * y + 127) / 255);
+}
 
 // closed division of two values
 std::uint8_t fixdiv(std::uint8_t x, std::uint8_t y);
 
+// fixdiv's results indexed by y * 256 + x. Three bytes of padding follow the last entry so vector
+// code may read a whole 32-bit word at any index.
+const std::uint8_t* fixdiv_table();
+
+// batch forms: result[i] = fixmul(x[i], y[i]) (or fixdiv) for n values. fixmul_n compiles to
+// vector code; fixdiv_n is a tight table lookup.
+void fixmul_n(const std::uint8_t* x, const std::uint8_t* y, std::uint8_t* result, std::size_t n);
+void fixdiv_n(const std::uint8_t* x, const std::uint8_t* y, std::uint8_t* result, std::size_t n);
+
 /**************************************************************************************************/
 
 template <typename T>
@@ -224,6 +240,27 @@ using rgba16_t = rgba<std::uint16_t>;
 using rgba32_t = rgba<std::uint32_t>;
 using rgba64_t = rgba<std::uint64_t>; // for accumulators, etc.
 
+/**************************************************************************************************/
+
+inline auto sq_distance(std::int64_t x, std::int64_t y) {
+    std::int64_t diff(x - y);
+
+    return diff * diff;
+}
+
+/**************************************************************************************************/
+
+inline auto sq_distance(const rgba_t& x, const rgba_t& y) {
+    return sq_distance(x._r, y._r) + sq_distance(x._g, y._g) + sq_distance(x._b, y._b) +
+           sq_distance(x._a, y._a);
+}
+
+/**************************************************************************************************/
+
+inline auto euclidean_distance(const rgba_t& x, const rgba_t& y) {
+    return std::sqrt(sq_distance(x, y));
+}
+
 /**************************************************************************************************/
 #if 0
 template <typename T>
@@ -0,0 +1,24 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+#ifndef PNGPP_SIMD_HPP__
+#define PNGPP_SIMD_HPP__
+
+/**************************************************************************************************/
+// PNGPP_X86_DISPATCH is 1 where vector kernels can be compiled with __attribute__((target(...)))
+// and picked at run time with __builtin_cpu_supports(). Everywhere else only the portable
+// kernels are built.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PNGPP_X86_DISPATCH 1
+#include <immintrin.h>
+#else
+#define PNGPP_X86_DISPATCH 0
+#endif
+
+/**************************************************************************************************/
+
+#endif // PNGPP_SIMD_HPP__
+
+/**************************************************************************************************/
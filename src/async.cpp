@@ -0,0 +1,106 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+// identity
+#include <pngpp/async.hpp>
+
+// stdc++
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+// tbb
+#ifdef __has_include
+#if __has_include(<tbb/version.h>)
+#include <tbb/version.h> // oneTBB no longer has tbb_stddef.h
+#endif
+#endif
+#ifndef TBB_INTERFACE_VERSION
+#include <tbb/tbb_stddef.h>
+#endif
+
+#if TBB_INTERFACE_VERSION >= 11000
+#include <tbb/global_control.h>
+#else
+#include <tbb/task_scheduler_init.h>
+#endif
+
+/**************************************************************************************************/
+
+namespace {
+
+/**************************************************************************************************/
+
+std::mutex              pending_mutex_s;
+std::condition_variable pending_done_s;
+std::size_t             pending_s{0};
+
+/**************************************************************************************************/
+
+} // namespace
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+tbb::task_arena& executor() {
+    // The arena below holds no slot for an application thread, so it cannot run anything without
+    // a worker. TBB allows one worker fewer than there are cores, which is none on a single core
+    // machine, so the limit is raised to at least one before the arena is first used.
+#if TBB_INTERFACE_VERSION >= 11000
+    static tbb::global_control workers(
+        tbb::global_control::max_allowed_parallelism,
+        std::max<std::size_t>(2, tbb::this_task_arena::max_concurrency()));
+#else
+    static tbb::task_scheduler_init workers(
+        std::max(2, tbb::task_scheduler_init::default_num_threads()));
+#endif
+
+    // no slots are held back for application threads: every slot is for enqueued work, and a
+    // thread that waits on a future just blocks rather than joining in.
+    static tbb::task_arena arena(tbb::task_arena::automatic, 0);
+
+    return arena;
+}
+
+/**************************************************************************************************/
+
+void wait_for_tasks() {
+    std::unique_lock<std::mutex> lock(pending_mutex_s);
+
+    pending_done_s.wait(lock, []() { return pending_s == 0; });
+}
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/**************************************************************************************************/
+
+void begin_task() {
+    std::lock_guard<std::mutex> lock(pending_mutex_s);
+
+    ++pending_s;
+}
+
+/**************************************************************************************************/
+
+void end_task() {
+    std::lock_guard<std::mutex> lock(pending_mutex_s);
+
+    if (--pending_s == 0)
+        pending_done_s.notify_all();
+}
+
+/**************************************************************************************************/
+
+} // namespace detail
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
@@ -0,0 +1,680 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+// identity
+#include <pngpp/encoder.hpp>
+
+// stdc++
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// tbb
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+// Since zlib 1.2.12, deflateParams() on a stream fresh from deflateReset() only changes settings.
+// Earlier versions could flush a block into it, so there a reused stream is rebuilt instead.
+#if ZLIB_VERNUM >= 0x12c0
+#define PNGPP_DEFLATE_PARAMS_AFTER_RESET 1
+#else
+#define PNGPP_DEFLATE_PARAMS_AFTER_RESET 0
+#endif
+
+/**************************************************************************************************/
+
+using namespace pngpp;
+
+/**************************************************************************************************/
+
+namespace {
+
+/**************************************************************************************************/
+
+constexpr std::size_t filter_type_count_k{5}; // PNG_FILTER_VALUE_NONE .. PNG_FILTER_VALUE_PAETH
+
+// libpng's own compression buffer size, so IDAT chunking matches what libpng would write.
+constexpr std::size_t idat_size_k{1024 * 1024};
+
+// how much filtered input deflate sees between checks against the budget.
+constexpr std::size_t deflate_slice_k{64 * 1024};
+
+// how much filtered input each task compresses when deflating in parallel.
+constexpr std::size_t parallel_strip_k{256 * 1024};
+
+// the deflate window; also how much of the prior strip primes each parallel strip's dictionary.
+constexpr int         max_window_bits_k{15};
+constexpr std::size_t max_window_k{std::size_t(1) << max_window_bits_k};
+
+// streams kept per thread for reuse, and the bytes they may hold between them; see
+// pooled_stream(). A stream larger than that is freed rather than pooled.
+constexpr std::size_t stream_pool_k{4};
+constexpr std::size_t stream_pool_bytes_k{8 * 1024 * 1024};
+
+// a PNG's bytes outside its IDAT data: signature, IHDR, PLTE, tRNS, IEND, and the framing of
+// every IDAT chunk.
+inline std::size_t png_overhead(const image_t& image, std::size_t idat_size) {
+    const std::size_t colors(image.color_table().size());
+
+    return 8 + 25 + (12 + 3 * colors) + (12 + colors) + 12 + 12 * (idat_size / idat_size_k + 1);
+}
+
+/**************************************************************************************************/
+
+std::vector<bufferstream_t>& stream_pool() {
+    static thread_local std::vector<bufferstream_t> pool_s;
+
+    return pool_s;
+}
+
+/**************************************************************************************************/
+// the IDAT staging buffer for encode_filtered, one per thread and at least `size` bytes. Callers
+// never ask for more than idat_size_k.
+buffer_t& idat_scratch(std::size_t size) {
+    static thread_local buffer_t scratch_s;
+
+    if (scratch_s.size() < size)
+        scratch_s = buffer_t(size);
+
+    return scratch_s;
+}
+
+/**************************************************************************************************/
+
+inline int filter_flag(std::size_t type) {
+    return PNG_FILTER_NONE << type;
+}
+
+/**************************************************************************************************/
+
+inline std::uint8_t paeth(std::uint8_t a, std::uint8_t b, std::uint8_t c) {
+    int p(a + b - c);
+    int pa(std::abs(p - a));
+    int pb(std::abs(p - b));
+    int pc(std::abs(p - c));
+
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/**************************************************************************************************/
+// `prev` is the unfiltered prior row; for the first row it is all zeroes.
+void filter_row(std::uint8_t*       dst,
+                const std::uint8_t* row,
+                const std::uint8_t* prev,
+                std::size_t         rowbytes,
+                std::size_t         bpp,
+                std::size_t         type) {
+    switch (type) {
+        case PNG_FILTER_VALUE_NONE:
+            std::copy(row, row + rowbytes, dst);
+            break;
+        case PNG_FILTER_VALUE_SUB:
+            for (std::size_t i(0); i < rowbytes; ++i)
+                dst[i] = row[i] - (i < bpp ? 0 : row[i - bpp]);
+            break;
+        case PNG_FILTER_VALUE_UP:
+            for (std::size_t i(0); i < rowbytes; ++i)
+                dst[i] = row[i] - prev[i];
+            break;
+        case PNG_FILTER_VALUE_AVG:
+            for (std::size_t i(0); i < rowbytes; ++i)
+                dst[i] = row[i] - ((i < bpp ? 0 : row[i - bpp]) + prev[i]) / 2;
+            break;
+        case PNG_FILTER_VALUE_PAETH:
+            for (std::size_t i(0); i < rowbytes; ++i)
+                dst[i] = row[i] - (i < bpp ? prev[i] : paeth(row[i - bpp], prev[i], prev[i - bpp]));
+            break;
+    }
+}
+
+/**************************************************************************************************/
+// libpng's heuristic for adaptive filtering: treat the filtered bytes as signed and sum their
+// magnitudes; the smallest sum wins.
+std::size_t filter_cost(const std::uint8_t* first, const std::uint8_t* last) {
+    std::size_t result{0};
+
+    while (first != last) {
+        std::uint8_t v(*first++);
+
+        result += v < 128 ? v : 256 - v;
+    }
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+void write_uint32(bufferstream_t& stream, std::uint32_t x) {
+    const std::uint8_t bytes[4]{static_cast<std::uint8_t>(x >> 24),
+                                static_cast<std::uint8_t>(x >> 16),
+                                static_cast<std::uint8_t>(x >> 8),
+                                static_cast<std::uint8_t>(x)};
+
+    stream.write(bytes, sizeof(bytes));
+}
+
+/**************************************************************************************************/
+
+void write_chunk(bufferstream_t&     stream,
+                 const char*         type,
+                 const std::uint8_t* data,
+                 std::size_t         size) {
+    uLong crc(crc32(0, reinterpret_cast<const Bytef*>(type), 4));
+
+    write_uint32(stream, static_cast<std::uint32_t>(size));
+    stream.write(type, 4);
+
+    if (size) {
+        stream.write(data, size);
+        crc = crc32(crc, data, static_cast<uInt>(size));
+    }
+
+    write_uint32(stream, static_cast<std::uint32_t>(crc));
+}
+
+/**************************************************************************************************/
+
+void write_header(bufferstream_t& stream, const image_t& image) {
+    const std::uint8_t signature[8]{137, 80, 78, 71, 13, 10, 26, 10};
+
+    stream.write(signature, sizeof(signature));
+
+    const std::uint32_t width(static_cast<std::uint32_t>(image.width()));
+    const std::uint32_t height(static_cast<std::uint32_t>(image.height()));
+    const std::uint8_t  ihdr[13]{static_cast<std::uint8_t>(width >> 24),
+                                static_cast<std::uint8_t>(width >> 16),
+                                static_cast<std::uint8_t>(width >> 8),
+                                static_cast<std::uint8_t>(width),
+                                static_cast<std::uint8_t>(height >> 24),
+                                static_cast<std::uint8_t>(height >> 16),
+                                static_cast<std::uint8_t>(height >> 8),
+                                static_cast<std::uint8_t>(height),
+                                static_cast<std::uint8_t>(image.depth()),
+                                static_cast<std::uint8_t>(image.color_type()),
+                                PNG_COMPRESSION_TYPE_DEFAULT,
+                                PNG_FILTER_TYPE_DEFAULT,
+                                PNG_INTERLACE_NONE};
+
+    write_chunk(stream, "IHDR", ihdr, sizeof(ihdr));
+
+    const auto& color_table(image.color_table());
+
+    if (color_table.empty())
+        return;
+
+    std::vector<std::uint8_t> ctable;
+    std::vector<std::uint8_t> atable;
+    bool                      uses_alpha{false};
+
+    for (const auto& entry : color_table) {
+        ctable.push_back(entry._r);
+        ctable.push_back(entry._g);
+        ctable.push_back(entry._b);
+        atable.push_back(entry._a);
+
+        if (entry._a != 255)
+            uses_alpha = true;
+    }
+
+    write_chunk(stream, "PLTE", ctable.data(), ctable.size());
+
+    if (uses_alpha)
+        write_chunk(stream, "tRNS", atable.data(), atable.size());
+}
+
+/**************************************************************************************************/
+// libpng shrinks the zlib window for small images; the smaller window costs nothing in
+// compression and saves decoders memory.
+int window_bits(std::size_t data_size) {
+    int result(max_window_bits_k);
+
+    if (data_size <= 16384) {
+        std::size_t half_window_size(std::size_t(1) << (result - 1));
+
+        while (data_size + 262 <= half_window_size) {
+            half_window_size >>= 1;
+            --result;
+        }
+    }
+
+    return std::max(result, 9);
+}
+
+/**************************************************************************************************/
+// The two byte zlib stream header deflateInit2 would have written for these settings.
+void write_zlib_header(bufferstream_t& stream, const deflate_options_t& options, int bits) {
+    const int level(options._z_compression == Z_DEFAULT_COMPRESSION ? 6 :
+                                                                       options._z_compression);
+    const int flevel(options._z_strategy >= Z_HUFFMAN_ONLY || level < 2 ?
+                         0 :
+                         level < 6 ? 1 : level == 6 ? 2 : 3);
+    const int cmf(((bits - 8) << 4) | Z_DEFLATED);
+    int       flg(flevel << 6);
+
+    flg += 31 - (cmf * 256 + flg) % 31;
+
+    const std::uint8_t header[2]{static_cast<std::uint8_t>(cmf), static_cast<std::uint8_t>(flg)};
+
+    stream.write(header, sizeof(header));
+}
+
+/**************************************************************************************************/
+
+// A zlib deflate state at MAX_MEM_LEVEL is a few hundred KB; building one per trial means
+// allocating and page-faulting it afresh every time. Instead each thread keeps the states it has
+// built, by window size, and a deflater_t borrows an idle one, sets its level and strategy with
+// deflateParams(), and hands it back reset.
+struct cached_deflate_t {
+    int      _bits;
+    bool     _busy{false};
+    z_stream _z{};
+
+    explicit cached_deflate_t(int bits) : _bits(bits) {
+        if (deflateInit2(&_z,
+                         Z_DEFAULT_COMPRESSION,
+                         Z_DEFLATED,
+                         bits,
+                         MAX_MEM_LEVEL,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("deflateInit2 failed");
+    }
+
+    ~cached_deflate_t() {
+        deflateEnd(&_z);
+    }
+};
+
+// an idle cached state for `bits` on this thread, built if there is none. The state lives on the
+// heap, as zlib keeps a pointer back to its z_stream.
+cached_deflate_t& idle_deflate(int bits) {
+    static thread_local std::vector<std::unique_ptr<cached_deflate_t>> cache_s;
+
+    for (auto& entry : cache_s)
+        if (entry->_bits == bits && !entry->_busy)
+            return *entry;
+
+    cache_s.emplace_back(new cached_deflate_t(bits));
+
+    return *cache_s.back();
+}
+
+/**************************************************************************************************/
+
+class deflater_t {
+    cached_deflate_t& _state;
+
+public:
+    // negative `bits` produce a raw deflate stream with no zlib header or trailer.
+    deflater_t(const deflate_options_t& options, int bits) : _state(idle_deflate(bits)) {
+#if PNGPP_DEFLATE_PARAMS_AFTER_RESET
+        if (deflateParams(&_state._z, options._z_compression, options._z_strategy) != Z_OK)
+            throw std::runtime_error("deflateParams failed");
+#else
+        deflateEnd(&_state._z);
+
+        if (deflateInit2(&_state._z,
+                         options._z_compression,
+                         Z_DEFLATED,
+                         bits,
+                         MAX_MEM_LEVEL,
+                         options._z_strategy) != Z_OK)
+            throw std::runtime_error("deflateInit2 failed");
+#endif
+
+        _state._busy = true;
+    }
+
+    ~deflater_t() {
+        deflateReset(&_state._z);
+
+        _state._busy = false;
+    }
+
+    z_stream& get() {
+        return _state._z;
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+buffer_t filter_image(const image_t& image, int png_filter) {
+    const std::size_t height(image.height());
+    const std::size_t rowbytes(image.rowbytes());
+    const std::size_t stride(rowbytes + 1);
+    const std::size_t bpp(std::max<std::size_t>(image.bpp(), 1));
+    buffer_t          result(height * stride);
+    const auto        src(image.data());
+    const auto        dst(result.data());
+
+    // a lone filter needs no scoring; more than one means adaptive filtering.
+    std::size_t single_type(filter_type_count_k);
+    std::size_t filter_count(0);
+
+    for (std::size_t type(0); type < filter_type_count_k; ++type) {
+        if ((png_filter & filter_flag(type)) == 0)
+            continue;
+
+        single_type = type;
+        ++filter_count;
+    }
+
+    if (filter_count == 0) {
+        single_type  = PNG_FILTER_VALUE_NONE;
+        filter_count = 1;
+    }
+
+    // rows only depend on the unfiltered image, so they can be filtered independently.
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, height), [&](const auto& range) {
+        const std::vector<std::uint8_t> zero_row(rowbytes, 0);
+        std::vector<std::uint8_t>       scratch(filter_count == 1 ? 0 : stride);
+
+        for (std::size_t y(range.begin()); y != range.end(); ++y) {
+            const std::uint8_t* row(src + y * rowbytes);
+            const std::uint8_t* prev(y ? row - rowbytes : zero_row.data());
+            std::uint8_t*       out(dst + y * stride);
+
+            if (filter_count == 1) {
+                out[0] = static_cast<std::uint8_t>(single_type);
+                filter_row(out + 1, row, prev, rowbytes, bpp, single_type);
+                continue;
+            }
+
+            std::size_t best_cost(std::numeric_limits<std::size_t>::max());
+
+            for (std::size_t type(0); type < filter_type_count_k; ++type) {
+                if ((png_filter & filter_flag(type)) == 0)
+                    continue;
+
+                filter_row(&scratch[1], row, prev, rowbytes, bpp, type);
+
+                std::size_t cost(filter_cost(&scratch[1], &scratch[0] + stride));
+
+                if (cost >= best_cost)
+                    continue;
+
+                best_cost  = cost;
+                scratch[0] = static_cast<std::uint8_t>(type);
+
+                std::copy(scratch.begin(), scratch.end(), out);
+            }
+        }
+    });
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+std::vector<std::size_t> filter_costs(const image_t& image, std::size_t row_step) {
+    const std::size_t               height(image.height());
+    const std::size_t               rowbytes(image.rowbytes());
+    const std::size_t               bpp(std::max<std::size_t>(image.bpp(), 1));
+    const std::vector<std::uint8_t> zero_row(rowbytes, 0);
+    std::vector<std::uint8_t>       scratch(rowbytes);
+    std::vector<std::size_t>        result(filter_type_count_k, 0);
+
+    row_step = std::max<std::size_t>(row_step, 1);
+
+    for (std::size_t y(0); y < height; y += row_step) {
+        const std::uint8_t* row(image.data() + y * rowbytes);
+        const std::uint8_t* prev(y ? row - rowbytes : zero_row.data());
+
+        for (std::size_t type(0); type < filter_type_count_k; ++type) {
+            filter_row(scratch.data(), row, prev, rowbytes, bpp, type);
+
+            result[type] += filter_cost(scratch.data(), scratch.data() + rowbytes);
+        }
+    }
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+bufferstream_t pooled_stream(std::size_t size) {
+    auto&          pool(stream_pool());
+    bufferstream_t result;
+
+    if (!pool.empty()) {
+        // the largest is the likeliest to need no growing
+        auto largest(std::max_element(pool.begin(), pool.end(), [](const auto& x, const auto& y) {
+            return x.capacity() < y.capacity();
+        }));
+
+        result = std::move(*largest);
+
+        pool.erase(largest);
+    }
+
+    result.clear();
+    result.reserve(size);
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+void recycle_stream(bufferstream_t stream) {
+    // held by a pool, a stream lives until its thread exits; the encode of a large image must not
+    // leave every worker holding a copy of it.
+    if (!stream.capacity() || stream.capacity() > stream_pool_bytes_k)
+        return;
+
+    auto& pool(stream_pool());
+
+    pool.push_back(std::move(stream));
+
+    // the pool keeps the largest streams that fit its limits
+    std::sort(pool.begin(), pool.end(), [](const auto& x, const auto& y) {
+        return x.capacity() > y.capacity();
+    });
+
+    auto        last(pool.begin());
+    std::size_t bytes(0);
+
+    while (last != pool.end() && static_cast<std::size_t>(last - pool.begin()) < stream_pool_k &&
+           bytes + last->capacity() <= stream_pool_bytes_k)
+        bytes += (last++)->capacity();
+
+    pool.erase(last, pool.end());
+}
+
+/**************************************************************************************************/
+
+bufferstream_t encode_filtered(const image_t&                  image,
+                               const buffer_t&                 filtered,
+                               const deflate_options_t&        options,
+                               const std::atomic<std::size_t>& budget) {
+    deflater_t        deflater(options, window_bits(filtered.size()));
+    z_stream&         z(deflater.get());
+    const std::size_t bound(deflateBound(&z, filtered.size()));
+
+    // a trial never writes past the budget, nor past the worst case deflate allows
+    bufferstream_t stream(pooled_stream(std::min<std::size_t>(budget,
+                                                              bound + png_overhead(image, bound))));
+
+    write_header(stream, image);
+
+    const std::size_t   idat_size(std::min(idat_size_k, bound));
+    buffer_t&           idat(idat_scratch(idat_size));
+    const std::uint8_t* next(filtered.data());
+    std::size_t         remaining(filtered.size());
+    int                 result(Z_OK);
+
+    z.next_out  = idat.data();
+    z.avail_out = static_cast<uInt>(idat_size);
+
+    while (result != Z_STREAM_END) {
+        if (z.avail_in == 0 && remaining) {
+            std::size_t slice(std::min(deflate_slice_k, remaining));
+
+            z.next_in  = const_cast<Bytef*>(next);
+            z.avail_in = static_cast<uInt>(slice);
+            next += slice;
+            remaining -= slice;
+        }
+
+        result = deflate(&z, remaining ? Z_NO_FLUSH : Z_FINISH);
+
+        if (result == Z_STREAM_ERROR)
+            throw std::runtime_error("deflate failed");
+
+        std::size_t pending(idat_size - z.avail_out);
+
+        if (z.avail_out == 0 || result == Z_STREAM_END) {
+            write_chunk(stream, "IDAT", idat.data(), pending);
+
+            z.next_out  = idat.data();
+            z.avail_out = static_cast<uInt>(idat_size);
+            pending     = 0;
+        }
+
+        // this trial cannot beat the best found so far; stop wasting time on it.
+        if (stream.size() + pending >= budget) {
+            recycle_stream(std::move(stream));
+
+            return bufferstream_t();
+        }
+    }
+
+    write_chunk(stream, "IEND", nullptr, 0);
+
+    if (stream.size() >= budget) {
+        recycle_stream(std::move(stream));
+
+        return bufferstream_t();
+    }
+
+    return stream;
+}
+
+/**************************************************************************************************/
+
+bufferstream_t encode_filtered_parallel(const image_t&           image,
+                                        const buffer_t&          filtered,
+                                        const deflate_options_t& options) {
+    const std::size_t size(filtered.size());
+    const std::size_t strip_count((size + parallel_strip_k - 1) / parallel_strip_k);
+
+    if (strip_count < 2) {
+        std::atomic<std::size_t> unlimited{std::numeric_limits<std::size_t>::max()};
+
+        return encode_filtered(image, filtered, options, unlimited);
+    }
+
+    // Each strip becomes a raw deflate stream primed with the window of input before it. All but
+    // the last end in a sync flush, which leaves them byte aligned and not final, so they can be
+    // concatenated into one valid stream. The zlib wrapper is then added by hand.
+    std::vector<bufferstream_t> strips(strip_count);
+    std::vector<uLong>          adlers(strip_count);
+
+    tbb::parallel_for<std::size_t>(0, strip_count, 1, [&](std::size_t i) {
+        const std::size_t   offset(i * parallel_strip_k);
+        const std::size_t   length(std::min(parallel_strip_k, size - offset));
+        const std::uint8_t* first(filtered.data() + offset);
+        const bool          last(i + 1 == strip_count);
+        deflater_t          deflater(options, -max_window_bits_k);
+        z_stream&           z(deflater.get());
+
+        if (offset) {
+            std::size_t primer(std::min(max_window_k, offset));
+
+            deflateSetDictionary(&z, first - primer, static_cast<uInt>(primer));
+        }
+
+        std::uint8_t scratch[deflate_slice_k];
+        int          result(Z_OK);
+
+        z.next_in  = const_cast<Bytef*>(first);
+        z.avail_in = static_cast<uInt>(length);
+
+        do {
+            z.next_out  = scratch;
+            z.avail_out = sizeof(scratch);
+
+            result = deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+
+            if (result == Z_STREAM_ERROR)
+                throw std::runtime_error("deflate failed");
+
+            strips[i].write(scratch, sizeof(scratch) - z.avail_out);
+        } while (last ? result != Z_STREAM_END : z.avail_out == 0);
+
+        adlers[i] = adler32(adler32(0, nullptr, 0), first, static_cast<uInt>(length));
+    });
+
+    bufferstream_t zdata;
+    uLong          adler(adlers[0]);
+
+    write_zlib_header(zdata, options, max_window_bits_k);
+
+    for (std::size_t i(0); i < strip_count; ++i) {
+        zdata.write(strips[i].data(), strips[i].size());
+
+        if (i)
+            adler = adler32_combine(adler,
+                                    adlers[i],
+                                    std::min(parallel_strip_k, size - i * parallel_strip_k));
+    }
+
+    write_uint32(zdata, static_cast<std::uint32_t>(adler));
+
+    bufferstream_t stream;
+
+    write_header(stream, image);
+
+    for (std::size_t offset(0); offset < zdata.size(); offset += idat_size_k)
+        write_chunk(stream,
+                    "IDAT",
+                    zdata.data() + offset,
+                    std::min(idat_size_k, zdata.size() - offset));
+
+    write_chunk(stream, "IEND", nullptr, 0);
+
+    return stream;
+}
+
+/**************************************************************************************************/
+
+std::size_t deflated_size(const std::uint8_t*       data,
+                          std::size_t               size,
+                          const deflate_options_t&  options) {
+    deflater_t deflater(options, window_bits(size));
+    z_stream&  z(deflater.get());
+
+    std::uint8_t scratch[deflate_slice_k];
+    int          result(Z_OK);
+
+    z.next_in  = const_cast<Bytef*>(data);
+    z.avail_in = static_cast<uInt>(size);
+
+    while (result != Z_STREAM_END) {
+        z.next_out  = scratch;
+        z.avail_out = sizeof(scratch);
+
+        result = deflate(&z, Z_FINISH);
+
+        if (result == Z_STREAM_ERROR)
+            throw std::runtime_error("deflate failed");
+    }
+
+    return z.total_out;
+}
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
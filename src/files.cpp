@@ -5,6 +5,19 @@
 // application
 #include <pngpp/files.hpp>
 
+// stdc++
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /**************************************************************************************************/
 
 namespace pngpp {
@@ -36,6 +49,122 @@ path_t derived_filename(path_t src, const std::string& new_leaf) {
     return src / new_filename;
 }
 
+/**************************************************************************************************/
+#ifndef _WIN32
+
+namespace {
+
+/**************************************************************************************************/
+// reads everything available from `fd` into `buffer`, returning the byte count. pread is used so
+// the descriptor's offset is left alone; descriptors that cannot seek fall back to read.
+std::size_t read_all(int fd, buffer_t& buffer) {
+    constexpr std::size_t read_size_k{64 * 1024};
+
+    std::size_t size{0};
+    bool        seekable{true};
+
+    while (true) {
+        if (size == buffer.size())
+            buffer.resize(size + read_size_k);
+
+        void*       dst(buffer.data() + size);
+        std::size_t room(buffer.size() - size);
+        ssize_t     count(seekable ? ::pread(fd, dst, room, static_cast<off_t>(size)) :
+                                 ::read(fd, dst, room));
+
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (seekable && errno == ESPIPE) {
+                seekable = false;
+                continue;
+            }
+
+            throw std::runtime_error("file could not be read");
+        }
+
+        if (count == 0)
+            return size;
+
+        size += count;
+    }
+}
+
+/**************************************************************************************************/
+
+struct descriptor_t {
+    int _fd{-1};
+
+    ~descriptor_t() {
+        if (_fd >= 0)
+            ::close(_fd);
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace
+
+/**************************************************************************************************/
+
+file_view_t::file_view_t(const path_t& path) {
+    descriptor_t descriptor{::open(path.string().c_str(), O_RDONLY)};
+    struct stat  info;
+
+    if (descriptor._fd < 0)
+        throw std::runtime_error("file could not be opened for read");
+
+    if (::fstat(descriptor._fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapping(::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor._fd, 0));
+
+        if (mapping != MAP_FAILED) {
+            ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+
+            _data   = static_cast<const std::uint8_t*>(mapping);
+            _size   = info.st_size;
+            _mapped = true;
+
+            return;
+        }
+    }
+
+    _size = read_all(descriptor._fd, _copy);
+    _data = _copy.data();
+}
+
+/**************************************************************************************************/
+
+file_view_t::~file_view_t() {
+    if (_mapped)
+        ::munmap(const_cast<std::uint8_t*>(_data), _size);
+}
+
+/**************************************************************************************************/
+#else
+/**************************************************************************************************/
+
+file_view_t::file_view_t(const path_t& path) {
+    std::ifstream input(path.string().c_str(), std::ios_base::in | std::ios_base::binary);
+
+    if (!input)
+        throw std::runtime_error("file could not be opened for read");
+
+    input.seekg(0, std::ios_base::end);
+    _copy = buffer_t(static_cast<std::size_t>(input.tellg()));
+    input.seekg(0, std::ios_base::beg);
+    input.read(reinterpret_cast<char*>(_copy.data()), _copy.size());
+
+    _data = _copy.data();
+    _size = static_cast<std::size_t>(input.gcount());
+}
+
+/**************************************************************************************************/
+
+file_view_t::~file_view_t() {}
+
+/**************************************************************************************************/
+#endif
 /**************************************************************************************************/
 
 } // namespace pngpp
@@ -0,0 +1,184 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+// identity
+#include <pngpp/histogram.hpp>
+
+// stdc++
+#include <algorithm>
+#include <stdexcept>
+
+// tbb
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_reduce.h>
+
+/**************************************************************************************************/
+
+using namespace pngpp;
+
+/**************************************************************************************************/
+
+namespace {
+
+/**************************************************************************************************/
+
+constexpr std::size_t initial_bits_k{10};
+
+// rows per histogram task
+constexpr std::size_t row_grain_k{16};
+
+/**************************************************************************************************/
+// the packed color of the pixel at `p`, read the way image_t::pixel() does
+inline std::uint32_t packed_pixel(const std::uint8_t* p, std::size_t bpp) {
+    return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) |
+           (bpp == 4 ? p[3] : 255);
+}
+
+/**************************************************************************************************/
+// parallel_reduce body: each split gets its own table; join() merges them.
+class histogram_body_t {
+    const image_t& _image;
+
+public:
+    color_histogram_t _histogram;
+
+    explicit histogram_body_t(const image_t& image) : _image(image) {}
+
+    histogram_body_t(histogram_body_t& x, tbb::split) : _image(x._image) {}
+
+    void operator()(const tbb::blocked_range<std::size_t>& range) {
+        const auto width(_image.width());
+        const auto rowbytes(_image.rowbytes());
+        const auto bpp(_image.bpp());
+
+        for (std::size_t y(range.begin()); y != range.end(); ++y) {
+            const std::uint8_t* p(_image.data() + y * rowbytes);
+
+            for (std::size_t x(0); x < width; ++x, p += bpp)
+                _histogram.add(packed_pixel(p, bpp));
+        }
+    }
+
+    void join(histogram_body_t& x) {
+        // fold the smaller table into the larger
+        if (_histogram.size() < x._histogram.size())
+            std::swap(_histogram, x._histogram);
+
+        _histogram.merge(x._histogram);
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+color_histogram_t::color_histogram_t()
+    : _keys(std::size_t(1) << initial_bits_k), _counts(std::size_t(1) << initial_bits_k),
+      _shift(32 - initial_bits_k) {}
+
+/**************************************************************************************************/
+
+void color_histogram_t::grow() {
+    if (_shift == 0)
+        throw std::runtime_error("color histogram overflow");
+
+    color_histogram_t bigger;
+
+    bigger._shift = _shift - 1;
+    bigger._keys.assign(capacity() * 2, 0);
+    bigger._counts.assign(capacity() * 2, 0);
+
+    for_each([&](std::uint32_t key, std::uint64_t count, std::size_t) { bigger.add(key, count); });
+
+    std::swap(*this, bigger);
+}
+
+/**************************************************************************************************/
+
+void color_histogram_t::add(std::uint32_t key, std::uint64_t count) {
+    const std::size_t mask(capacity() - 1);
+
+    for (std::size_t i(home(key));; i = (i + 1) & mask) {
+        if (!_counts[i]) {
+            _keys[i]   = key;
+            _counts[i] = count;
+
+            if (++_size * 2 > capacity())
+                grow();
+
+            return;
+        }
+
+        if (_keys[i] == key) {
+            _counts[i] += count;
+
+            return;
+        }
+    }
+}
+
+/**************************************************************************************************/
+
+void color_histogram_t::merge(const color_histogram_t& x) {
+    x.for_each([&](std::uint32_t key, std::uint64_t count, std::size_t) { add(key, count); });
+}
+
+/**************************************************************************************************/
+
+std::size_t color_histogram_t::slot(std::uint32_t key) const {
+    const std::size_t mask(capacity() - 1);
+    std::size_t       i(home(key));
+
+    while (_keys[i] != key || !_counts[i])
+        i = (i + 1) & mask;
+
+    return i;
+}
+
+/**************************************************************************************************/
+
+std::vector<std::pair<rgba_t, std::uint64_t>> color_histogram_t::sorted() const {
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> packed;
+
+    packed.reserve(size());
+
+    for_each([&](std::uint32_t key, std::uint64_t count, std::size_t) {
+        packed.emplace_back(key, count);
+    });
+
+    std::sort(packed.begin(), packed.end(), [](const auto& x, const auto& y) {
+        return x.first < y.first;
+    });
+
+    std::vector<std::pair<rgba_t, std::uint64_t>> result;
+
+    result.reserve(packed.size());
+
+    for (const auto& entry : packed)
+        result.emplace_back(unpack_rgba(entry.first), entry.second);
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+color_histogram_t color_histogram(const image_t& image) {
+    histogram_body_t body(image);
+
+    tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, image.height(), row_grain_k), body);
+
+    return std::move(body._histogram);
+}
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
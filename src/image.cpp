@@ -6,29 +6,233 @@
 #include <pngpp/image.hpp>
 
 // tbb
+#include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
 
+// application
+#include <pngpp/simd.hpp>
+
+/**************************************************************************************************/
+
+namespace {
+
+/**************************************************************************************************/
+
+using namespace pngpp;
+
+/**************************************************************************************************/
+// pixels per parallel task: 32KB of RGBA, small enough to stay in cache while it is worked on.
+constexpr std::size_t pixel_grain_k{8 * 1024};
+
+typedef void (*pixel_kernel_t)(std::uint8_t*, std::size_t);
+
+/**************************************************************************************************/
+
+void premultiply_scalar(std::uint8_t* p, std::size_t count) {
+    for (auto last(p + count * 4); p != last; p += 4) {
+        auto a{p[3]};
+
+        if (a != 255) {
+            p[0] = fixmul(p[0], a);
+            p[1] = fixmul(p[1], a);
+            p[2] = fixmul(p[2], a);
+        }
+    }
+}
+
+/**************************************************************************************************/
+
+void unpremultiply_scalar(std::uint8_t* p, std::size_t count) {
+    for (auto last(p + count * 4); p != last; p += 4) {
+        auto a{p[3]};
+
+        if (a != 255) {
+            p[0] = fixdiv(p[0], a);
+            p[1] = fixdiv(p[1], a);
+            p[2] = fixdiv(p[2], a);
+        }
+    }
+}
+
+/**************************************************************************************************/
+#if PNGPP_X86_DISPATCH
+/**************************************************************************************************/
+// fixmul(x, a) is exactly round(x * a / 255), which in 16 bit lanes is
+// t = x * a + 128; (t + (t >> 8)) >> 8. Alpha bytes are blended back in untouched.
+
+__attribute__((target("sse4.1"))) void premultiply_sse41(std::uint8_t* p, std::size_t count) {
+    const __m128i zero(_mm_setzero_si128());
+    const __m128i bias(_mm_set1_epi16(128));
+    const __m128i spread(_mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15));
+    const __m128i alpha_mask(_mm_set1_epi32(0xff000000));
+    std::size_t   n(count / 4);
+
+    for (std::size_t i(0); i < n; ++i, p += 16) {
+        __m128i px(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        __m128i alpha(_mm_shuffle_epi8(px, spread));
+        __m128i lo(_mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), _mm_unpacklo_epi8(alpha, zero)));
+        __m128i hi(_mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), _mm_unpackhi_epi8(alpha, zero)));
+
+        lo = _mm_add_epi16(lo, bias);
+        hi = _mm_add_epi16(hi, bias);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        __m128i result(_mm_blendv_epi8(_mm_packus_epi16(lo, hi), px, alpha_mask));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), result);
+    }
+
+    premultiply_scalar(p, count % 4);
+}
+
+/**************************************************************************************************/
+
+__attribute__((target("avx2"))) void premultiply_avx2(std::uint8_t* p, std::size_t count) {
+    const __m256i zero(_mm256_setzero_si256());
+    const __m256i bias(_mm256_set1_epi16(128));
+    const __m256i spread(_mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+                                          3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15));
+    const __m256i alpha_mask(_mm256_set1_epi32(0xff000000));
+    std::size_t   n(count / 8);
+
+    for (std::size_t i(0); i < n; ++i, p += 32) {
+        __m256i px(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+        __m256i alpha(_mm256_shuffle_epi8(px, spread));
+        __m256i lo(
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(px, zero), _mm256_unpacklo_epi8(alpha, zero)));
+        __m256i hi(
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(px, zero), _mm256_unpackhi_epi8(alpha, zero)));
+
+        lo = _mm256_add_epi16(lo, bias);
+        hi = _mm256_add_epi16(hi, bias);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+
+        __m256i result(_mm256_blendv_epi8(_mm256_packus_epi16(lo, hi), px, alpha_mask));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), result);
+    }
+
+    premultiply_scalar(p, count % 8);
+}
+
+/**************************************************************************************************/
+// fixdiv carries the rounding of its floating point definition, which no short integer formula
+// reproduces. Instead the vector path gathers from the fixdiv table, indexed by
+// (alpha << 8) | channel; the table's padding lets each 32 bit gather read past the last entry.
+
+__attribute__((target("avx2"))) void unpremultiply_avx2(std::uint8_t* p, std::size_t count) {
+    const auto    table(reinterpret_cast<const int*>(fixdiv_table()));
+    const __m256i byte_mask(_mm256_set1_epi32(0xff));
+    const __m256i opaque(_mm256_set1_epi32(0xff));
+    std::size_t   n(count / 8);
+
+    for (std::size_t i(0); i < n; ++i, p += 32) {
+        __m256i px(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+        __m256i a(_mm256_srli_epi32(px, 24));
+        __m256i base(_mm256_slli_epi32(a, 8));
+        __m256i r_index(_mm256_or_si256(base, _mm256_and_si256(px, byte_mask)));
+        __m256i g_index(
+            _mm256_or_si256(base, _mm256_and_si256(_mm256_srli_epi32(px, 8), byte_mask)));
+        __m256i b_index(
+            _mm256_or_si256(base, _mm256_and_si256(_mm256_srli_epi32(px, 16), byte_mask)));
+        __m256i r(_mm256_i32gather_epi32(table, r_index, 1));
+        __m256i g(_mm256_i32gather_epi32(table, g_index, 1));
+        __m256i b(_mm256_i32gather_epi32(table, b_index, 1));
+
+        __m256i result(_mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(r, byte_mask),
+                            _mm256_slli_epi32(_mm256_and_si256(g, byte_mask), 8)),
+            _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b, byte_mask), 16),
+                            _mm256_slli_epi32(a, 24))));
+
+        // opaque pixels are left exactly as they were, as in the scalar path.
+        result = _mm256_blendv_epi8(result, px, _mm256_cmpeq_epi32(a, opaque));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), result);
+    }
+
+    unpremultiply_scalar(p, count % 8);
+}
+
+/**************************************************************************************************/
+
+pixel_kernel_t select_premultiply() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return &premultiply_avx2;
+
+    if (__builtin_cpu_supports("sse4.1"))
+        return &premultiply_sse41;
+
+    return &premultiply_scalar;
+}
+
+pixel_kernel_t select_unpremultiply() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return &unpremultiply_avx2;
+
+    return &unpremultiply_scalar;
+}
+
+/**************************************************************************************************/
+#else
+/**************************************************************************************************/
+
+pixel_kernel_t select_premultiply() {
+    return &premultiply_scalar;
+}
+
+pixel_kernel_t select_unpremultiply() {
+    return &unpremultiply_scalar;
+}
+
+/**************************************************************************************************/
+#endif
+/**************************************************************************************************/
+
+void for_each_block(image_t& image, pixel_kernel_t kernel) {
+    auto base{image.data()};
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, image.area(), pixel_grain_k),
+                      [_base = base, kernel](const auto& range) {
+                          kernel(_base + range.begin() * 4, range.size());
+                      });
+}
+
+/**************************************************************************************************/
+
+} // namespace
+
 /**************************************************************************************************/
 
 namespace pngpp {
 
 /**************************************************************************************************/
 
-image_t premultiply(image_t image) {
-    if (image.bpp() == 4 && !image.premultiplied()) {
-        auto area{image.area()};
-        auto base{image.data()};
+void premultiply_rgba(std::uint8_t* pixels, std::size_t count) {
+    static const pixel_kernel_t kernel_s(select_premultiply());
+
+    kernel_s(pixels, count);
+}
 
-        tbb::parallel_for<decltype(area)>(0, area, 1, [_base = base](auto i) {
-            auto p{_base + i * 4};
-            auto a{p[3]};
+/**************************************************************************************************/
+
+void unpremultiply_rgba(std::uint8_t* pixels, std::size_t count) {
+    static const pixel_kernel_t kernel_s(select_unpremultiply());
 
-            if (a != 255) {
-                p[0] = fixmul(p[0], a);
-                p[1] = fixmul(p[1], a);
-                p[2] = fixmul(p[2], a);
-            }
-        });
+    kernel_s(pixels, count);
+}
+
+/**************************************************************************************************/
+
+image_t premultiply(image_t image) {
+    if (image.bpp() == 4 && !image.premultiplied()) {
+        for_each_block(image, &premultiply_rgba);
 
         image.set_premultiplied(true);
     }
@@ -41,19 +245,7 @@ image_t premultiply(image_t image) {
 image_t unpremultiply(image_t image) {
     // there be rounding error dragons here.
     if (image.bpp() == 4 && image.premultiplied()) {
-        auto area{image.area()};
-        auto base{image.data()};
-
-        tbb::parallel_for<decltype(area)>(0, area, 1, [_base = base](auto i) {
-            auto p{_base + i * 4};
-            auto a{p[3]};
-
-            if (a != 255) {
-                p[0] = fixdiv(p[0], a);
-                p[1] = fixdiv(p[1], a);
-                p[2] = fixdiv(p[2], a);
-            }
-        });
+        for_each_block(image, &unpremultiply_rgba);
 
         image.set_premultiplied(false);
     }
@@ -0,0 +1,109 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+// identity
+#include <pngpp/image_stats.hpp>
+
+// stdc++
+#include <algorithm>
+#include <unordered_set>
+
+// application
+#include <pngpp/encoder.hpp>
+
+/**************************************************************************************************/
+
+namespace {
+
+/**************************************************************************************************/
+
+constexpr std::size_t sample_rows_k{256};
+
+// past this many colors the exact count stops mattering to classification.
+constexpr std::size_t unique_color_cap_k{1 << 16};
+
+/**************************************************************************************************/
+
+} // namespace
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+image_stats_t compute_image_stats(const image_t& image) {
+    image_stats_t result;
+    const auto    height(image.height());
+    const auto    width(image.width());
+    const auto    rowbytes(image.rowbytes());
+    const auto    bpp(image.bpp());
+    const bool    has_alpha((image.color_type() & PNG_COLOR_MASK_ALPHA) != 0); // last in a pixel
+    const auto    row_step(std::max<std::size_t>(height / sample_rows_k, 1));
+
+    std::unordered_set<std::uint32_t> colors;
+    std::size_t                       same_bytes{0};
+    std::size_t                       compared_bytes{0};
+
+    for (std::size_t y(0); y < height; y += row_step) {
+        const std::uint8_t* row(image.data() + y * rowbytes);
+
+        for (std::size_t x(0); x < width && colors.size() < unique_color_cap_k; ++x) {
+            const std::uint8_t* p(row + x * bpp);
+            std::uint32_t       packed{0};
+
+            for (std::size_t i(0); i < bpp; ++i)
+                packed = (packed << 8) | p[i];
+
+            colors.insert(packed);
+
+            if (has_alpha && p[bpp - 1] != 255)
+                result._uses_alpha = true;
+        }
+
+        if (y == 0)
+            continue;
+
+        const std::uint8_t* prev(row - rowbytes);
+
+        for (std::size_t i(0); i < rowbytes; ++i)
+            same_bytes += row[i] == prev[i];
+
+        compared_bytes += rowbytes;
+    }
+
+    for (const auto& entry : image.color_table())
+        if (entry._a != 255)
+            result._uses_alpha = true;
+
+    result._unique_colors   = colors.size();
+    result._row_correlation = compared_bytes ? static_cast<double>(same_bytes) / compared_bytes : 0;
+    result._filter_costs    = filter_costs(image, row_step);
+    result._best_filter     = std::min_element(result._filter_costs.begin(),
+                                           result._filter_costs.end()) -
+                          result._filter_costs.begin();
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+image_class classify(const image_stats_t& stats) {
+    if (stats._unique_colors <= PNG_MAX_PALETTE_LENGTH)
+        return image_class::palette;
+
+    if (stats._row_correlation >= 0.5)
+        return stats._uses_alpha ? image_class::flat : image_class::screenshot;
+
+    if (stats._row_correlation >= 0.25 && stats._unique_colors < 4096)
+        return image_class::screenshot;
+
+    return image_class::photo;
+}
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
@@ -45,7 +45,7 @@ future<void> dump_color_table(const image_t& image, path_t output) {
             }
         }
 
-        save_png(table, _output, save_options_t()).get();
+        save_png_sync(table, _output, save_options_t());
     });
 }
 
@@ -54,15 +54,24 @@ future<void> dump_color_table(const image_t& image, path_t output) {
 future<void> dump_image(image_t   image,
                         path_t    output,
                         save_mode mode) {
-    return async([_image = std::move(image), _output = std::move(output), _mode = mode]() {
-        dump_color_table(_image, associated_filename(_output, "table"));
+    auto         claim(std::make_shared<save_claim_t>(image));
+    future<void> table(dump_color_table(image, associated_filename(output, "table")));
 
-        save_options_t options;
+    return then(std::move(table),
+                [_image  = std::move(image),
+                 _output = std::move(output),
+                 _mode   = mode,
+                 _claim  = std::move(claim)](future<void> table) {
+                    table.get(); // rethrows if the table could not be saved
 
-        options._mode = _mode;
+                    save_options_t options;
 
-        save_png(_image.premultiplied() ? unpremultiply(_image) : _image, _output, options).get();
-    });
+                    options._mode = _mode;
+
+                    save_png_sync(_image.premultiplied() ? unpremultiply(_image) : _image,
+                                  _output,
+                                  options);
+                });
 }
 
 /**************************************************************************************************/
@@ -3,12 +3,17 @@
 /**************************************************************************************************/
 
 // stdc++
+#include <chrono>
 #include <iostream>
 #include <numeric>
 #include <random>
+#include <set>
 
 // tbb
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
+#include <tbb/parallel_reduce.h>
 
 // boost
 #include <boost/program_options.hpp>
@@ -16,6 +21,8 @@
 // application
 #include <pngpp/files.hpp>
 #include <pngpp/png.hpp>
+#include <pngpp/quantize.hpp>
+#include <pngpp/quantizers.hpp>
 #include <pngpp/rgba.hpp>
 #include <pngpp/image_utils.hpp>
 
@@ -97,187 +104,187 @@ inline double grey(const rgba_t& c) {
 
 /**************************************************************************************************/
 
-typedef std::map<rgba_t, std::size_t> truecolor_histogram_t;
-
-truecolor_histogram_t truecolor_histogram(const image_t& image) {
-    truecolor_histogram_t result;
-    auto                  bpp(image.bpp());
-    auto                  p(image.begin());
-    auto                  last(image.end());
+// Each color's squared distance to the nearest seed chosen so far. Adding seeds only compares
+// the colors against the new ones, so choosing k seeds one at a time costs O(n k) rather than
+// O(n k^2). Totals are kept per fixed chunk of colors, so sampling scans one chunk rather than
+// every color.
+class seed_distances_t {
+    static constexpr std::size_t chunk_k{4096};
+
+    const std::vector<rgba_t>&      _colors;
+    const std::vector<std::size_t>* _weights{nullptr}; // counts per color; all 1 when null
+    std::vector<std::int64_t>       _sq_d;
+    std::vector<std::uint64_t>      _chunk_totals; // sum of weight * _sq_d per chunk
+    std::uint64_t                   _total{0};
+
+    std::uint64_t weight(std::size_t i) const {
+        return _weights ? (*_weights)[i] : 1;
+    }
 
-    if (bpp == 3) {
-        while (p != last) {
-            rgba_t rgb{
-                *p++, *p++, *p++, 255,
-            };
+    // lowers each distance with d(i), and re-totals
+    template <typename F>
+    std::uint64_t update(F d) {
+        tbb::parallel_for(std::size_t(0), _chunk_totals.size(), [&](std::size_t chunk) {
+            std::size_t   last(std::min(_colors.size(), (chunk + 1) * chunk_k));
+            std::uint64_t sum(0);
 
-            ++result[rgb];
-        }
-    } else if (bpp == 4) {
-        while (p != last) {
-            rgba_t rgb{
-                *p++, *p++, *p++, *p++,
-            };
-
-            ++result[rgb];
-        }
-    }
+            for (std::size_t i(chunk * chunk_k); i < last; ++i) {
+                _sq_d[i] = std::min(_sq_d[i], d(i));
 
-    return result;
-}
+                sum += weight(i) * _sq_d[i];
+            }
 
-/**************************************************************************************************/
+            _chunk_totals[chunk] = sum;
+        });
 
-inline auto sq_distance(std::int64_t x, std::int64_t y) {
-    std::int64_t diff(x - y);
+        _total = std::accumulate(_chunk_totals.begin(), _chunk_totals.end(), std::uint64_t(0));
 
-    return diff * diff;
-}
+        return _total;
+    }
 
-/**************************************************************************************************/
+public:
+    explicit seed_distances_t(const std::vector<rgba_t>&      colors,
+                              const std::vector<std::size_t>* weights = nullptr)
+        : _colors(colors), _weights(weights),
+          _sq_d(colors.size(), std::numeric_limits<std::int64_t>::max()),
+          _chunk_totals((colors.size() + chunk_k - 1) / chunk_k) {}
 
-inline auto sq_distance(const rgba_t& x, const rgba_t& y) {
-    return sq_distance(x._r, y._r) + sq_distance(x._g, y._g) + sq_distance(x._b, y._b) +
-           sq_distance(x._a, y._a);
-}
+    // lowers each distance to that of `seed` if nearer, and returns the new total.
+    std::uint64_t add(const rgba_t& seed) {
+        return update([&](std::size_t i) { return sq_distance(_colors[i], seed); });
+    }
 
-/**************************************************************************************************/
+    // as above, for a batch of seeds
+    std::uint64_t add(const color_table_t& seeds) {
+        soa_colors_t table(seeds);
 
-inline auto euclidean_distance(const rgba_t& x, const rgba_t& y) {
-    return std::sqrt(sq_distance(x, y));
-}
+        return update([&](std::size_t i) { return table.nearest(_colors[i]).second; });
+    }
 
-/**************************************************************************************************/
+    std::int64_t sq_d(std::size_t i) const {
+        return _sq_d[i];
+    }
 
-std::vector<std::int64_t> compute_sq_d(const std::vector<rgba_t>& colors,
-                                       const std::vector<rgba_t>& seeds) {
-    std::size_t               count(colors.size());
-    std::vector<std::int64_t> values(count);
+    std::uint64_t total() const {
+        return _total;
+    }
 
-    tbb::parallel_for<std::size_t>(0,
-                                   count,
-                                   1,
-                                   [& _colors = colors, &_seeds = seeds, &_values = values](
-                                       std::size_t i) {
-                                       const auto&  color = _colors[i];
-                                       std::int64_t d(std::numeric_limits<std::int64_t>::max());
+    // a color drawn with probability proportional to weight * distance. total() must be nonzero.
+    template <typename Generator>
+    std::size_t sample(Generator& gen) const {
+        std::uniform_int_distribution<std::uint64_t> dist(0, _total - 1);
+        std::uint64_t                                target(dist(gen));
+        std::size_t                                  chunk(0);
 
-                                       for (const auto& seed : _seeds) {
-                                           d = std::min(d, sq_distance(color, seed));
+        for (; target >= _chunk_totals[chunk]; ++chunk)
+            target -= _chunk_totals[chunk];
 
-                                           // color is a seed; we're done here.
-                                           if (d == 0)
-                                               break;
-                                       }
+        std::size_t i(chunk * chunk_k);
 
-                                       _values[i] = d;
-                                   });
+        for (std::uint64_t sum(0); (sum += weight(i) * _sq_d[i]) <= target; ++i) {
+        }
 
-    return values;
-}
+        return i;
+    }
+};
 
 /**************************************************************************************************/
 
-std::vector<rgba_t> k_means_pp(const std::vector<rgba_t>& v, std::size_t n) {
+// k-means++ seeding over `v`, weighted by `weights` (one per color) when given. Seeding draws
+// from `gen` only, so concurrent calls each need their own.
+std::vector<rgba_t> k_means_pp(const std::vector<rgba_t>&      v,
+                               std::size_t                     n,
+                               std::mt19937&                   gen,
+                               const std::vector<std::size_t>* weights = nullptr) {
     if (v.empty() || v.size() <= n)
         return v;
 
-    static std::random_device rd;
-    static std::mt19937       gen(rd());
+    // the first seed too is drawn in proportion to weight
+    std::size_t first(0);
 
-    std::uniform_int_distribution<> i_dist(0, v.size() - 1);
-    std::vector<rgba_t>             result(1, v[i_dist(gen)]);
+    if (weights)
+        first = std::discrete_distribution<std::size_t>(weights->begin(), weights->end())(gen);
+    else
+        first = std::uniform_int_distribution<>(0, v.size() - 1)(gen);
 
-    while (result.size() < n) {
-        auto                         d(compute_sq_d(v, result));
-        std::discrete_distribution<> dist(d.begin(), d.end());
-        std::size_t                  index(dist(gen));
+    std::vector<rgba_t> result(1, v[first]);
+    seed_distances_t    distances(v, weights);
 
-        result.push_back(v[index]);
-    }
+    // every color is a seed already once the total is 0
+    while (result.size() < n && distances.add(result.back()))
+        result.push_back(v[distances.sample(gen)]);
 
     return result;
 }
 
 /**************************************************************************************************/
+// k-means|| seeding (Bahmani et al.): a few rounds each sample about 2n candidates at once, every
+// color independently with probability proportional to its distance. The candidates, weighted
+// by how many colors are nearest to each, are then reduced to n with k-means++. Sampling is done
+// over fixed chunks of colors, each with its own generator seeded from `gen`, so the outcome
+// does not depend on how the work is scheduled.
+std::vector<rgba_t> k_means_parallel(const std::vector<rgba_t>& v,
+                                     std::size_t                n,
+                                     std::mt19937&              gen) {
+    constexpr std::size_t rounds_k{5};
+    constexpr std::size_t chunk_k{4096};
 
-color_table_t make_grad_table() {
-    // grayscale gradient color table from black to white. It might be better to
-    // make this e.g., a green or yellow gradient instead, to ease visibility in
-    // the dark range.
-    std::size_t   count(PNG_MAX_PALETTE_LENGTH);
-    color_table_t result(count);
+    if (v.empty() || v.size() <= n)
+        return v;
 
-    for (std::size_t i(0); i < count; ++i) {
-        result[i]._r = i;
-        result[i]._g = i;
-        result[i]._b = i;
-        result[i]._a = 255;
+    std::uniform_int_distribution<> i_dist(0, v.size() - 1);
+    color_table_t                   candidates(1, v[i_dist(gen)]);
+    seed_distances_t                distances(v);
+    color_table_t                   added(candidates);
+    const double                    oversampling(2. * n);
+    const std::size_t               chunks((v.size() + chunk_k - 1) / chunk_k);
+
+    for (std::size_t round(0); round < rounds_k && distances.add(added); ++round) {
+        const double                     scale(oversampling / distances.total());
+        const std::uint32_t              round_seed(gen());
+        std::vector<std::vector<rgba_t>> picked(chunks);
+
+        tbb::parallel_for(std::size_t(0), chunks, [&](std::size_t chunk) {
+            std::seed_seq                          seq{round_seed, std::uint32_t(chunk)};
+            std::mt19937                           chunk_gen(seq);
+            std::uniform_real_distribution<double> coin(0, 1);
+            std::size_t                            last(std::min(v.size(), (chunk + 1) * chunk_k));
+
+            for (std::size_t i(chunk * chunk_k); i < last; ++i)
+                if (coin(chunk_gen) < scale * distances.sq_d(i))
+                    picked[chunk].push_back(v[i]);
+        });
+
+        added.clear();
+
+        for (const auto& chunk : picked)
+            added.insert(added.end(), chunk.begin(), chunk.end());
+
+        candidates.insert(candidates.end(), added.begin(), added.end());
     }
 
-    return result;
-}
-
-/**************************************************************************************************/
-
-std::pair<std::size_t, double> quantize(const rgba_t& c, const color_table_t& table) {
-    std::size_t  index{0};
-    std::int64_t min_error{std::numeric_limits<std::int64_t>::max()};
-    std::size_t  count(table.size());
+    if (candidates.size() <= n)
+        return candidates;
 
-    for (std::size_t i(0); i < count; ++i) {
-        std::int64_t error(sq_distance(c, table[i]));
-
-        if (error >= min_error)
-            continue;
-
-        index     = i;
-        min_error = error;
-
-        // exact match; no need to keep looking
-        if (min_error == 0)
-            break;
-    }
+    // weight each candidate by the colors it would claim, then pick n of them
+    soa_colors_t             table(candidates);
+    std::vector<std::size_t> weights(tbb::parallel_reduce(
+        tbb::blocked_range<std::size_t>(0, v.size(), chunk_k),
+        std::vector<std::size_t>(candidates.size(), 0),
+        [&](const auto& range, std::vector<std::size_t> counts) {
+            for (std::size_t i(range.begin()); i != range.end(); ++i)
+                ++counts[table.nearest(v[i]).first];
 
-    return std::make_pair(index, std::sqrt(min_error));
-}
+            return counts;
+        },
+        [](std::vector<std::size_t> x, const std::vector<std::size_t>& y) {
+            for (std::size_t i(0); i < x.size(); ++i)
+                x[i] += y[i];
 
-/**************************************************************************************************/
+            return x;
+        }));
 
-typedef std::pair<image_t, image_t> quantization_t;
-
-quantization_t quantize(const image_t& image, color_table_t color_table) {
-    image_t result(image.width(),
-                   image.height(),
-                   image.depth(),
-                   image.width(),
-                   PNG_COLOR_TYPE_PALETTE);
-    image_t error_result(image.width(),
-                         image.height(),
-                         image.depth(),
-                         image.width(),
-                         PNG_COLOR_TYPE_PALETTE);
-    auto dst(result.begin());
-    auto err_dst(error_result.begin());
-    auto area(image.area());
-
-    tbb::parallel_for<decltype(
-        area)>(0,
-               area,
-               1,
-               [& _image = image, _dst = dst, _err_dst = err_dst, &_color_table = color_table](
-                   auto i) {
-                   auto q(quantize(_image.pixel<std::uint8_t>(i), _color_table));
-
-                   _dst[i]     = q.first;
-                   _err_dst[i] = static_cast<std::uint8_t>(
-                       std::min<std::uint16_t>(std::lround(q.second), 255));
-               });
-
-    result.set_color_table(std::move(color_table));
-    error_result.set_color_table(make_grad_table());
-
-    return std::make_pair(std::move(result), std::move(error_result));
+    return k_means_pp(candidates, n, gen, &weights);
 }
 
 /**************************************************************************************************/
@@ -366,6 +373,22 @@ struct centroid_cache_t {
         centroid(index) += color;
     }
 
+    // adds `n` members of the same color at once
+    void add_members(std::size_t index, const rgba_t& color, std::uint64_t n) {
+        count(index) += n;
+
+        centroid(index) += rgba64_t{color._r * n, color._g * n, color._b * n, color._a * n};
+    }
+
+    // adds every region of `x` into the same region here
+    void merge(const centroid_cache_t& x) {
+        for (std::size_t i(0); i < size(); ++i) {
+            count(i) += x.count(i);
+
+            centroid(i) += x.centroid(i);
+        }
+    }
+
     void remove_member(std::size_t index, const rgba64_t& color) {
         --count(index);
 
@@ -403,37 +426,135 @@ struct centroid_cache_t {
 };
 
 /**************************************************************************************************/
+// Nearest-entry assignment of a fixed set of colors against a table that changes from round to
+// round, accelerated with Hamerly's bounds. Each color keeps an upper bound on the distance to its
+// entry and a lower bound on the distance to any other entry. When the entries move, the bounds
+// are loosened by how far they moved. A color whose upper bound stays below both its lower bound
+// and half the distance from its entry to the nearest other entry cannot have changed entries, so
+// it is skipped. Skips require a strict margin, so every assignment (ties included) is exactly
+// what a full search would give.
+class bounded_assignment_t {
+    std::vector<std::uint32_t> _entries;
+    std::vector<double>        _upper;
+    std::vector<double>        _lower;
+    color_table_t              _table; // the entries the bounds refer to
+
+    // bounds closer than this are treated as touching, which absorbs rounding in their updates.
+    static constexpr double margin_k{1e-6};
+
+    void search(const soa_colors_t& table, const rgba_t& c, std::size_t i) {
+        auto q(table.nearest_two(c));
+
+        _entries[i] = static_cast<std::uint32_t>(q._index);
+        _upper[i]   = std::sqrt(q._sq_d);
+        _lower[i]   = q._second_sq_d == std::numeric_limits<std::int64_t>::max() ?
+                        std::numeric_limits<double>::infinity() :
+                        std::sqrt(q._second_sq_d);
+    }
 
-struct round_state_t {
-    round_state_t() = default;
-
-    explicit round_state_t(std::size_t count) : _centroids(count) {}
+public:
+    explicit bounded_assignment_t(std::size_t count)
+        : _entries(count), _upper(count), _lower(count) {}
 
-    auto size() const {
-        return _centroids.size();
+    const auto& entries() const {
+        return _entries;
     }
 
-    color_table_t centroid_table() const {
-        return _centroids.table();
+    // assigns each of `colors` (the same colors every call) to its nearest entry of `table`
+    void assign(const std::vector<rgba_t>& colors, color_table_t table) {
+        const std::size_t   count(table.size());
+        const bool          first(_table.empty());
+        std::vector<double> moved(count, 0);     // how far each entry moved since the last call
+        std::vector<double> half_gap(count, std::numeric_limits<double>::infinity());
+
+        for (std::size_t j(0); !first && j < count; ++j)
+            moved[j] = euclidean_distance(_table[j], table[j]);
+
+        for (std::size_t j(0); j < count; ++j)
+            for (std::size_t k(j + 1); k < count; ++k) {
+                double gap(euclidean_distance(table[j], table[k]) / 2);
+
+                half_gap[j] = std::min(half_gap[j], gap);
+                half_gap[k] = std::min(half_gap[k], gap);
+            }
+
+        // the largest move and the entry that made it, then the largest of the others
+        std::size_t farthest(std::max_element(moved.begin(), moved.end()) - moved.begin());
+        double      max_moved(count ? moved[farthest] : 0);
+        double      runner_up(0);
+
+        for (std::size_t j(0); j < count; ++j)
+            if (j != farthest)
+                runner_up = std::max(runner_up, moved[j]);
+
+        _table = std::move(table);
+
+        soa_colors_t search_table(_table);
+
+        tbb::parallel_for(tbb::blocked_range<std::size_t>(0, colors.size(), 1024),
+                          [&](const auto& range) {
+                              for (std::size_t i(range.begin()); i != range.end(); ++i) {
+                                  if (first) {
+                                      search(search_table, colors[i], i);
+                                      continue;
+                                  }
+
+                                  std::size_t entry(_entries[i]);
+
+                                  _upper[i] += moved[entry];
+                                  _lower[i] -= entry == farthest ? runner_up : max_moved;
+
+                                  double bound(std::max(half_gap[entry], _lower[i]));
+
+                                  if (_upper[i] + margin_k < bound)
+                                      continue;
+
+                                  _upper[i] = euclidean_distance(colors[i], _table[entry]);
+
+                                  if (_upper[i] + margin_k < bound)
+                                      continue;
+
+                                  search(search_table, colors[i], i);
+                              }
+                          });
     }
+};
+
+/**************************************************************************************************/
 
-    std::uint64_t error() const {
-        return std::accumulate(_image_error.begin(), _image_error.end(), std::uint64_t(0));
+struct round_state_t {
+    explicit round_state_t(const unique_colors_t& colors)
+        : _image(colors.width(),
+                 colors.height(),
+                 colors.depth(),
+                 colors.width(),
+                 PNG_COLOR_TYPE_PALETTE),
+          _image_error(colors.width(),
+                       colors.height(),
+                       colors.depth(),
+                       colors.width(),
+                       PNG_COLOR_TYPE_PALETTE),
+          _assignment(colors.colors().size()), _sq_errors(colors.colors().size()),
+          _errors(colors.colors().size()) {
+        _image_error.set_color_table(make_grad_table());
     }
 
-    std::size_t      _r{0};        // iteration count
-    image_t          _image;       // original image quantized with current color table
-    image_t          _image_error; // rounded per-pixel quantization error
-    centroid_cache_t _centroids;   // cache of cumulative centroid values
+    std::size_t                _r{0};        // iteration count
+    image_t                    _image;       // original image quantized with current color table
+    image_t                    _image_error; // rounded per-pixel quantization error
+    std::uint64_t              _error{0};    // sum of squared per-pixel quantization error
+    centroid_cache_t           _centroids;   // cumulative centroid values of this round's regions
+    bounded_assignment_t       _assignment;  // per unique color: nearest table entry
+    std::vector<std::int64_t>  _sq_errors;   // per unique color: squared distance to it
+    std::vector<std::uint8_t>  _errors;      // per unique color: error image value
 };
 
 /**************************************************************************************************/
 
 void dump_round(const round_state_t& round, const path_t& output) {
-    auto error(round.error());
-    auto epp(static_cast<double>(error) / round._image.area());
+    auto epp(static_cast<double>(round._error) / round._image.area());
 
-    std::cout << "r" << round._r << " error: " << round.error() << " (" << epp << ")\n";
+    std::cout << "r" << round._r << " error: " << round._error << " (" << epp << ")\n";
 
     dump_quantization(round._image, // image contains this round's color table
                       round._image_error,
@@ -441,77 +562,156 @@ void dump_round(const round_state_t& round, const path_t& output) {
 }
 
 /**************************************************************************************************/
+// parallel_reduce body for the pixel pass of a k-means round: writes each pixel's entry and
+// error, and sums its region's centroid and the squared error into the worker's own totals.
+class assignment_body_t {
+    const unique_colors_t& _colors;
+    const round_state_t&   _state;
+    std::uint8_t*          _dst;
+    std::uint8_t*          _err_dst;
+
+public:
+    centroid_cache_t _centroids;
+    std::uint64_t    _error{0};
+
+    assignment_body_t(const unique_colors_t& colors, round_state_t& state, std::size_t count)
+        : _colors(colors), _state(state), _dst(state._image.data()),
+          _err_dst(state._image_error.data()), _centroids(count) {}
+
+    assignment_body_t(assignment_body_t& x, tbb::split)
+        : _colors(x._colors), _state(x._state), _dst(x._dst), _err_dst(x._err_dst),
+          _centroids(x._centroids.size()) {}
+
+    void operator()(const tbb::blocked_range<std::size_t>& range) {
+        const auto& pixels(_colors.pixels());
+        const auto& unique(_colors.colors());
+
+        for (std::size_t i(range.begin()); i != range.end(); ++i) {
+            auto        color(pixels[i]);
+            std::size_t entry(_state._assignment.entries()[color]);
+            const auto& c(unique[color]);
+
+            _dst[i]     = static_cast<std::uint8_t>(entry);
+            _err_dst[i] = _state._errors[color];
+            _error += _state._sq_errors[color];
+
+            _centroids.add_member(entry, rgba64_t{c._r, c._g, c._b, c._a});
+        }
+    }
+
+    void join(assignment_body_t& x) {
+        _centroids.merge(x._centroids);
 
-round_state_t k_means_init_state(const image_t& original, color_table_t seed) {
-    round_state_t result(seed.size());
+        _error += x._error;
+    }
+};
 
-    std::tie(result._image, result._image_error) = quantize(original, std::move(seed));
+/**************************************************************************************************/
+// Quantizes with `color_table` into the state's buffers, and gathers the regions' centroids and
+// the total error, in one parallel pass over the pixels.
+void k_means_round(const unique_colors_t& colors,
+                   color_table_t          color_table,
+                   round_state_t&         state) {
+    const auto& unique(colors.colors());
 
-    auto bpp(original.bpp());
-    auto p_index(result._image.begin());
-    auto p(original.begin());
-    auto last(original.end());
+    state._assignment.assign(unique, color_table);
 
-    while (p != last) {
-        std::size_t index(*p_index++);
-        rgba64_t color{p[0], p[1], p[2], static_cast<rgba64_t::value_type>(bpp == 4 ? p[3] : 255)};
+    const auto& entries(state._assignment.entries());
 
-        result._centroids.add_member(index, color);
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, unique.size(), 1024),
+                      [&](const auto& range) {
+                          for (std::size_t i(range.begin()); i != range.end(); ++i) {
+                              std::int64_t sq_error(
+                                  sq_distance(unique[i], color_table[entries[i]]));
 
-        p += bpp;
-    }
+                              state._sq_errors[i] = sq_error;
+                              state._errors[i]    = quantization_error(sq_error);
+                          }
+                      });
 
-    return result;
+    assignment_body_t body(colors, state, color_table.size());
+
+    tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, colors.pixels().size(), 4096), body);
+
+    state._centroids = std::move(body._centroids);
+    state._error     = body._error;
+
+    state._image.set_color_table(std::move(color_table));
 }
 
 /**************************************************************************************************/
 
-round_state_t k_means_round(const image_t& original,
-                            const image_t& prev_image,
-                            round_state_t  state) {
-    ++state._r;
+color_table_t k_means(const unique_colors_t& colors,
+                      color_table_t          color_table,
+                      const path_t&          output) {
+    round_state_t round_state(colors);
+    std::uint64_t best_error(std::numeric_limits<std::uint64_t>::max());
+    color_table_t best_table;
 
-    // requantize the original image with the updated centroid color table
-    std::tie(state._image, state._image_error) = quantize(original, state.centroid_table());
+    for (;; ++round_state._r) {
+        k_means_round(colors, color_table, round_state);
 
-    auto bpp(original.bpp());
-    auto p_prior_index(prev_image.begin());
-    auto p_index(state._image.begin());
-    auto p(original.begin());
-    auto last(original.end());
+        dump_round(round_state, output);
 
-    while (p != last) {
-        std::size_t prior_index(*p_prior_index++);
-        std::size_t index(*p_index++);
+        if (round_state._error < best_error) {
+            best_table = color_table; // copy
+            best_error = round_state._error;
 
-        if (prior_index == index) {
-            p += bpp;
-            continue;
+            // exact quantization found
+            if (best_error == 0)
+                break;
         }
 
-        rgba64_t color{*p++, *p++, *p++, std::uint64_t(bpp == 4 ? *p++ : 255)};
+        color_table_t next(round_state._centroids.table());
+
+        // no centroid moved, so no pixel will change regions
+        if (next == color_table)
+            break;
 
-        state._centroids.move_member(prior_index, index, color);
+        color_table = std::move(next);
     }
 
-    return state;
+    return best_table;
 }
 
 /**************************************************************************************************/
-
-color_table_t k_means(const image_t& image, color_table_t color_table, const path_t& output) {
-    round_state_t round_state(k_means_init_state(image, std::move(color_table)));
-    std::uint64_t best_error(std::numeric_limits<std::uint64_t>::max());
-    color_table_t best_table;
-    image_t       prev_image;
-
-    while (true) {
-        dump_round(round_state, output);
-
-        std::uint64_t error(round_state.error());
+// Lloyd iterations over the unique colors, each weighted by its pixel count, rather than over the
+// pixels. The centroid sums and squared error are the same as k_means() accumulates, so it
+// produces the same tables round for round, but no image is built until the caller quantizes with
+// the result. `report` prints each round's error.
+color_table_t histogram_k_means(const unique_colors_t& colors,
+                                color_table_t          color_table,
+                                bool                   report = true) {
+    const auto&                unique(colors.colors());
+    const auto&                counts(colors.counts());
+    const std::size_t          count(unique.size());
+    const double               area(colors.pixels().size());
+    bounded_assignment_t       assignment(count);
+    std::vector<std::uint32_t> prev_entries;
+    std::uint64_t              best_error(std::numeric_limits<std::uint64_t>::max());
+    color_table_t              best_table;
+
+    for (std::size_t r(0); true; ++r) {
+        assignment.assign(unique, color_table);
+
+        const auto& entries(assignment.entries());
+
+        std::uint64_t error(tbb::parallel_reduce(
+            tbb::blocked_range<std::size_t>(0, count, 1024),
+            std::uint64_t(0),
+            [&](const auto& range, std::uint64_t sum) {
+                for (std::size_t i(range.begin()); i != range.end(); ++i)
+                    sum += counts[i] * sq_distance(unique[i], color_table[entries[i]]);
+
+                return sum;
+            },
+            std::plus<std::uint64_t>()));
+
+        if (report)
+            std::cout << "r" << r << " error: " << error << " (" << error / area << ")\n";
 
         if (error < best_error) {
-            best_table = round_state._image.color_table(); // copy
+            best_table = color_table; // copy
             best_error = error;
 
             // exact quantization found
@@ -519,57 +719,207 @@ color_table_t k_means(const image_t& image, color_table_t color_table, const pat
                 break;
         }
 
-        if (prev_image == round_state._image)
+        if (prev_entries == entries)
             break;
 
-        prev_image = std::move(round_state._image);
+        centroid_cache_t centroids(color_table.size());
 
-        round_state._image_error = image_t();
+        for (std::size_t i(0); i < count; ++i)
+            centroids.add_members(entries[i], unique[i], counts[i]);
 
-        round_state = k_means_round(image, prev_image, std::move(round_state));
-    };
+        color_table  = centroids.table();
+        prev_entries = entries;
+    }
 
     return best_table;
 }
 
 /**************************************************************************************************/
 
-void k_means_quantization(const image_t& image, const path_t& output) {
-    truecolor_histogram_t histogram(truecolor_histogram(image));
-    std::vector<rgba_t>   colors;
+enum class k_means_mode {
+    pixels,   // requantize the image every round, saving each round's result
+    histogram // iterate on the weighted unique colors; see histogram_k_means()
+};
+
+enum class seeding_mode {
+    pp,      // k-means++, one seed at a time
+    parallel // k-means||, oversampled in a few parallel rounds
+};
+
+struct k_means_options_t {
+    k_means_mode _mode{k_means_mode::histogram};
+    seeding_mode _seeding{seeding_mode::pp};
+    quantizer_t  _quantizer{nullptr}; // when set, makes the table (or the seeds, with _refine)
+    bool         _refine{false};
+    bool         _sweep{false};       // every table size from 2 to 256; see k_means_sweep()
+    double       _max_error{0};       // per pixel; the sweep picks the smallest table within it
+};
+
+/**************************************************************************************************/
+// the starting table of `n` entries for the colors, as `options` selects
+color_table_t seed_table(const unique_colors_t&   unique,
+                         std::size_t              n,
+                         const k_means_options_t& options,
+                         std::mt19937&            gen) {
+    if (options._quantizer)
+        return options._quantizer(unique.colors(), unique.counts(), n);
+    else if (options._seeding == seeding_mode::parallel)
+        return k_means_parallel(unique.colors(), n, gen);
+    else
+        return k_means_pp(unique.colors(), n, gen);
+}
+
+/**************************************************************************************************/
+// the squared error of quantizing the colors against `table`, summed over the pixels
+std::uint64_t quantization_sq_error(const unique_colors_t& unique, const color_table_t& table) {
+    const auto&  colors(unique.colors());
+    const auto&  counts(unique.counts());
+    soa_colors_t soa(table);
+
+    return tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, colors.size(), 1024),
+                                std::uint64_t(0),
+                                [&](const auto& range, std::uint64_t sum) {
+                                    for (std::size_t i(range.begin()); i != range.end(); ++i)
+                                        sum += counts[i] * soa.nearest(colors[i]).second;
+
+                                    return sum;
+                                },
+                                std::plus<std::uint64_t>());
+}
+
+/**************************************************************************************************/
+
+void k_means_quantization(const image_t&           image,
+                          const path_t&            output,
+                          const k_means_options_t& options) {
+    // collapsed once; every quantization below works on unique colors only
+    unique_colors_t   unique(image);
+    const std::size_t table_size(256);
+    std::mt19937      gen(std::random_device{}());
+    color_table_t     seeds(seed_table(unique, table_size, options, gen));
+    auto              seed(quantize(unique, seeds));
+
+    dump_quantization(seed, derived_filename(output, std::to_string(table_size) + "_seed"));
+
+    // the fast quantizers' tables are final unless asked to refine them
+    if (options._quantizer && !options._refine) {
+        palette_optimizations(seed.first, output);
+
+        return;
+    }
+
+    color_table_t km_table(options._mode == k_means_mode::histogram ?
+                               histogram_k_means(unique, seeds) :
+                               k_means(unique, seeds, output));
+    auto          km(quantize(unique, km_table));
+
+    dump_quantization(km, derived_filename(output, std::to_string(table_size) + "_km"));
+
+    palette_optimizations(km.first, output);
+}
+
+/**************************************************************************************************/
+// Builds a table of each size from 2 to 256 (powers of two) concurrently from one collapse of the
+// image, and reports the error of each. Every size draws from its own generator, seeded from one
+// shared seed and the size, so the sweep does not depend on scheduling. Only the chosen table
+// (the smallest within the error budget, or else the largest) is saved. Refinement is always
+// histogram k-means, as pixel k-means saves every round under names that would collide.
+void k_means_sweep(const image_t& image, const path_t& output, const k_means_options_t& options) {
+    struct sweep_entry_t {
+        std::size_t   _size;
+        color_table_t _table;
+        std::uint64_t _error;
+    };
+
+    unique_colors_t            unique(image);
+    const double               area(unique.pixels().size());
+    const std::uint32_t        seed(std::random_device{}());
+    std::vector<sweep_entry_t> sweep;
 
-    for (const auto& color : histogram)
-        colors.push_back(color.first);
+    for (std::size_t size(2); size <= 256; size *= 2)
+        sweep.push_back(sweep_entry_t{size, color_table_t(), 0});
 
-    //auto tests = {2, 4, 8, 16, 32, 64, 128, 256};
-    auto tests = {256};
+    tbb::parallel_for_each(sweep.begin(), sweep.end(), [&](sweep_entry_t& entry) {
+        std::seed_seq seq{seed, std::uint32_t(entry._size)};
+        std::mt19937  gen(seq);
 
-    for (const auto& table_size : tests) {
-        std::vector<rgba_t> seed_table(k_means_pp(colors, table_size));
+        entry._table = seed_table(unique, entry._size, options, gen);
 
-        dump_quantization(quantize(image, seed_table),
-                          derived_filename(output, std::to_string(table_size) + "_seed"));
+        if (!options._quantizer || options._refine)
+            entry._table = histogram_k_means(unique, std::move(entry._table), false);
+
+        entry._error = quantization_sq_error(unique, entry._table);
+    });
 
-        color_table_t km_table(k_means(image, seed_table, output));
-        auto          km(quantize(image, km_table));
+    const sweep_entry_t* chosen(&sweep.back());
 
-        dump_quantization(km, derived_filename(output, std::to_string(table_size) + "_km"));
+    for (const auto& entry : sweep) {
+        std::cout << entry._size << " colors: error " << entry._error << " ("
+                  << entry._error / area << ")\n";
 
-        palette_optimizations(km.first, output);
+        if (chosen == &sweep.back() && options._max_error > 0 &&
+            entry._error / area <= options._max_error)
+            chosen = &entry;
     }
+
+    std::cout << "chose " << chosen->_size << " colors\n";
+
+    auto result(quantize(unique, chosen->_table));
+
+    dump_quantization(result, derived_filename(output, std::to_string(chosen->_size) + "_sweep"));
+
+    palette_optimizations(result.first, output);
 }
 
 /**************************************************************************************************/
 
-void truecolor_optimizations(const image_t& image, const path_t& output) {
+void truecolor_optimizations(const image_t&           image,
+                             const path_t&            output,
+                             const k_means_options_t& options) {
     if (image.color_type() == PNG_COLOR_TYPE_PALETTE)
         return;
 
 #if 0
-    k_means_quantization(image, output);
+    const image_t& source(image);
 #else
-    k_means_quantization(premultiply(image), output);
+    const image_t source(premultiply(image));
 #endif
+
+    if (options._sweep)
+        k_means_sweep(source, output, options);
+    else
+        k_means_quantization(source, output, options);
+}
+
+/**************************************************************************************************/
+
+void benchmark_save_modes(const image_t& image, const path_t& output) {
+    // reports each save mode's size and time, and how far each lands from the exhaustive optimum.
+    std::vector<std::pair<std::string, save_mode>> modes{{"one", save_mode::one},
+                                                         {"mid", save_mode::mid},
+                                                         {"halving", save_mode::halving},
+                                                         {"max", save_mode::max}};
+    std::vector<std::pair<std::size_t, double>> results;
+
+    for (const auto& mode : modes) {
+        save_options_t options;
+
+        options._mode = mode.second;
+
+        auto        start(std::chrono::steady_clock::now());
+        std::size_t size(save_png(image, derived_filename(output, mode.first), options).get());
+        std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - start);
+
+        results.emplace_back(size, elapsed.count());
+    }
+
+    const double optimum(results.back().first);
+
+    for (std::size_t i(0); i < modes.size(); ++i) {
+        std::cout << modes[i].first << ": " << results[i].first << " bytes in "
+                  << results[i].second << "s (+" << (results[i].first / optimum - 1) * 100
+                  << "% vs. max)\n";
+    }
 }
 
 /**************************************************************************************************/
@@ -591,18 +941,62 @@ int main(int argc, char** argv) try {
 
     output = canonical(output) / input.leaf();
 
+    std::set<std::string> flags(argv + 3, argv + argc);
+
+    // --save-budget=<MB> bounds the image copies that pending saves may hold
+    for (const auto& flag : flags)
+        if (flag.compare(0, 14, "--save-budget=") == 0)
+            set_save_budget(std::stoul(flag.substr(14)) << 20);
+
+    if (flags.count("--benchmark")) {
+        benchmark_save_modes(original, output);
+
+        return 0;
+    }
+
     dump_image(original, output, save_mode::max);
 
-    truecolor_optimizations(original, output);
+    k_means_options_t k_means_options;
+
+    // --pixel-k-means saves every k-means round, at the cost of requantizing the image each time
+    if (flags.count("--pixel-k-means"))
+        k_means_options._mode = k_means_mode::pixels;
+
+    if (flags.count("--parallel-seeding"))
+        k_means_options._seeding = seeding_mode::parallel;
+
+    // a fast quantizer in place of k-means; --k-means-refine uses its table as the k-means seeds
+    if (flags.count("--median-cut"))
+        k_means_options._quantizer = &median_cut;
+    else if (flags.count("--octree"))
+        k_means_options._quantizer = &octree;
+    else if (flags.count("--wu"))
+        k_means_options._quantizer = &wu;
+
+    k_means_options._refine = flags.count("--k-means-refine") != 0;
+
+    // --sweep tries every table size; --max-error=<e> picks the smallest within e per pixel
+    k_means_options._sweep = flags.count("--sweep") != 0;
+
+    for (const auto& flag : flags)
+        if (flag.compare(0, 12, "--max-error=") == 0)
+            k_means_options._max_error = std::stod(flag.substr(12));
+
+    truecolor_optimizations(original, output, k_means_options);
 
     palette_optimizations(original, output);
 
+    // the dumps above run in the background
+    wait_for_tasks();
+
     return 0;
 } catch (const std::exception& error) {
     std::cerr << "Fatal error: " << error.what() << '\n';
+    wait_for_tasks();
     return 0;
 } catch (...) {
     std::cerr << "Fatal error: unknown\n";
+    wait_for_tasks();
     return 0;
 }
 /**************************************************************************************************/
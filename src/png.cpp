@@ -6,12 +6,25 @@
 #include <pngpp/png.hpp>
 
 // stdc++
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <mutex>
+#include <numeric>
 #include <vector>
 
 // tbb
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
 
+// application
+#include <pngpp/encoder.hpp>
+#include <pngpp/image_stats.hpp>
+#include <pngpp/png_errors.hpp>
+
 /**************************************************************************************************/
 
 using namespace pngpp;
@@ -43,20 +56,19 @@ std::vector<png_byte*> buffer_rows(png_byte* p, std::size_t height, std::size_t
 
 /**************************************************************************************************/
 
+// decodes a PNG held entirely in memory (e.g., a mapped file.)
 class png_reader_t {
-    std::ifstream _input;
-    png_structp   _png_struct{nullptr};
-    png_infop     _png_info{nullptr};
-    png_infop     _png_end_info{nullptr};
+    const std::uint8_t* _first{nullptr};
+    const std::uint8_t* _last{nullptr};
+    png_structp         _png_struct{nullptr};
+    png_infop           _png_info{nullptr};
+    png_infop           _png_end_info{nullptr};
 
     static void read_thunk(png_structp png, png_bytep buffer, png_size_t size);
     void read(png_bytep buffer, png_size_t size);
 
-    static void fail(png_structp, png_const_charp);
-    static void warn(png_structp, png_const_charp);
-
 public:
-    explicit png_reader_t(const path_t& path);
+    png_reader_t(const std::uint8_t* data, std::size_t size);
     ~png_reader_t();
 
     image_t read();
@@ -66,17 +78,14 @@ public:
 
 /**************************************************************************************************/
 
-png_reader_t::png_reader_t(const path_t& path)
-    : _input(path.string().c_str(), std::ios_base::in | std::ios_base::binary),
+png_reader_t::png_reader_t(const std::uint8_t* data, std::size_t size)
+    : _first(data), _last(data + size),
       _png_struct(png_create_read_struct(PNG_LIBPNG_VER_STRING,
                                          nullptr,
-                                         &png_reader_t::fail,
-                                         &png_reader_t::warn)),
+                                         &detail::png_fail,
+                                         &detail::png_warn)),
       _png_info(png_create_info_struct(_png_struct)),
       _png_end_info(png_create_info_struct(_png_struct)) {
-    if (!_input)
-        png_error(_png_struct, "file could not be opened for read");
-
     if (!_png_struct)
         png_error(_png_struct, "png_create_read_struct failed");
 
@@ -98,22 +107,13 @@ png_reader_t::~png_reader_t() {
 
 /**************************************************************************************************/
 
-void png_reader_t::fail(png_structp, png_const_charp message) {
-    squawk(message);
-
-    throw std::runtime_error(message);
-}
-
-/**************************************************************************************************/
-
-void png_reader_t::warn(png_structp, png_const_charp message) {
-    squawk(message);
-}
+void png_reader_t::read(png_bytep buffer, png_size_t size) {
+    if (size > static_cast<std::size_t>(_last - _first))
+        png_error(_png_struct, "read past end of data");
 
-/**************************************************************************************************/
+    std::memcpy(buffer, _first, size);
 
-void png_reader_t::read(png_bytep buffer, png_size_t size) {
-    _input.read(reinterpret_cast<char*>(buffer), size);
+    _first += size;
 }
 
 /**************************************************************************************************/
@@ -209,41 +209,14 @@ struct one_options_t {
     int _png_filter{PNG_ALL_FILTERS};
 };
 
-struct image_params_t {
-    std::size_t            _width{0};
-    std::size_t            _height{0};
-    std::size_t            _depth{0};
-    std::size_t            _rowbytes{0};
-    std::size_t            _color_type{0};
-    const color_table_t&   _color_table;
-    std::vector<png_byte*> _rows;
-
-    explicit image_params_t(const image_t& image);
-};
-
-image_params_t::image_params_t(const image_t& image)
-    : _width(image.width()), _height(image.height()), _depth(image.depth()),
-      _rowbytes(image.rowbytes()), _color_type(image.color_type()),
-      _color_table(image.color_table()),
-      _rows(buffer_rows(const_cast<png_byte*>(image.data()), _height, _rowbytes)) {}
-
-/**************************************************************************************************/
-
 class png_saver_t {
     std::ofstream _output;
 
-    static void flush_thunk(png_structp png) {}
-    static void write_thunk(png_structp png, png_bytep buffer, png_size_t size);
-
-    static void fail(png_structp, png_const_charp);
-    static void warn(png_structp, png_const_charp);
-
 public:
     explicit png_saver_t(const path_t& path);
     ~png_saver_t();
 
     std::size_t save(const image_t& image, const save_options_t& options);
-    static bufferstream_t write_one(const image_params_t& image, const one_options_t& options);
 };
 
 /**************************************************************************************************/
@@ -257,162 +230,253 @@ png_saver_t::~png_saver_t() {}
 
 /**************************************************************************************************/
 
-void png_saver_t::fail(png_structp, png_const_charp message) {
-    squawk(message);
-
-    throw std::runtime_error(message);
+// The settings that win most often for each kind of content; `best` is the PNG filter that the
+// image's own statistics favor.
+std::vector<one_options_t> class_options(image_class kind, int best) {
+    switch (kind) {
+        case image_class::palette:
+            return {{9, Z_DEFAULT_STRATEGY, PNG_FILTER_NONE},
+                    {9, Z_FILTERED, PNG_FILTER_NONE},
+                    {9, Z_DEFAULT_STRATEGY, best},
+                    {9, Z_DEFAULT_STRATEGY, PNG_ALL_FILTERS}};
+        case image_class::flat:
+            return {{9, Z_DEFAULT_STRATEGY, PNG_FILTER_NONE},
+                    {6, Z_DEFAULT_STRATEGY, PNG_FILTER_NONE},
+                    {9, Z_DEFAULT_STRATEGY, best},
+                    {9, Z_FILTERED, best}};
+        case image_class::screenshot:
+            return {{9, Z_DEFAULT_STRATEGY, PNG_FILTER_NONE},
+                    {9, Z_DEFAULT_STRATEGY, best},
+                    {9, Z_DEFAULT_STRATEGY, PNG_ALL_FILTERS},
+                    {9, Z_FILTERED, PNG_ALL_FILTERS}};
+        case image_class::photo:
+        default:
+            return {{9, Z_FILTERED, best},
+                    {9, Z_DEFAULT_STRATEGY, best},
+                    {9, Z_FILTERED, PNG_ALL_FILTERS},
+                    {9, Z_FILTERED, PNG_FILTER_PAETH}};
+    }
 }
 
 /**************************************************************************************************/
+// A handful of settings tailored to what the image looks like, rather than one list for every
+// image.
+std::vector<one_options_t> mid_options(const image_t& image) {
+    const image_stats_t        stats(compute_image_stats(image));
+    std::vector<one_options_t> result;
 
-void png_saver_t::warn(png_structp, png_const_charp message) {
-    squawk(message);
+    for (const auto& candidate :
+         class_options(classify(stats), PNG_FILTER_NONE << stats._best_filter)) {
+        // the best filter may already be one of the fixed picks.
+        auto found(std::find_if(result.begin(), result.end(), [&](const auto& x) {
+            return x._z_compression == candidate._z_compression &&
+                   x._z_strategy == candidate._z_strategy &&
+                   x._png_filter == candidate._png_filter;
+        }));
+
+        if (found == result.end())
+            result.push_back(candidate);
+    }
+
+    return result;
 }
 
 /**************************************************************************************************/
 
-void png_saver_t::write_thunk(png_structp png, png_bytep buffer, png_size_t size) {
-    if (!png || !buffer)
-        png_error(png, "invalid pointer");
-
-    bufferstream_t* saver(static_cast<bufferstream_t*>(png_get_io_ptr(png)));
+auto max_options_init() {
+    std::vector<one_options_t> result;
 
-    if (!saver)
-        png_error(png, "invalid pointer");
+    for (auto compression(Z_NO_COMPRESSION); compression <= Z_BEST_COMPRESSION; ++compression) {
+        for (auto strategy(Z_DEFAULT_STRATEGY); strategy <= Z_FIXED; ++strategy) {
+            for (const auto& filter : {PNG_FILTER_NONE,
+                                       PNG_FILTER_SUB,
+                                       PNG_FILTER_UP,
+                                       PNG_FILTER_AVG,
+                                       PNG_FILTER_PAETH}) {
+                result.push_back(one_options_t{compression, strategy, filter});
+            }
+        }
+    }
 
-    saver->write(buffer, size);
+    return result;
 }
 
 /**************************************************************************************************/
 
-bufferstream_t png_saver_t::write_one(const image_params_t& image, const one_options_t& options) {
-    bufferstream_t stream;
-
-    png_structp png_struct = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-                                                     nullptr,
-                                                     &png_saver_t::fail,
-                                                     &png_saver_t::warn);
+const auto& max_options() {
+    static std::vector<one_options_t> value_s(max_options_init());
 
-    if (!png_struct)
-        png_error(png_struct, "png_create_write_struct failed");
+    return value_s;
+}
 
-    png_infop png_info = png_create_info_struct(png_struct);
+/**************************************************************************************************/
 
-    if (!png_info)
-        png_error(png_struct, "png_create_info_struct failed");
+// The filtered scanlines for each distinct PNG filter a set of options uses. Filtering only
+// depends on the PNG filter, so each one is run over the image once and its scanlines are shared
+// by every zlib setting that uses it.
+class filter_cache_t {
+    std::vector<int>      _filters;
+    std::vector<buffer_t> _filtered;
 
-    png_set_write_fn(png_struct, &stream, &png_saver_t::write_thunk, &png_saver_t::flush_thunk);
+public:
+    filter_cache_t(const image_t& image, const std::vector<one_options_t>& options_set);
 
-    png_set_compression_buffer_size(png_struct, 1024 * 1024); // 1MB compression buffer
-    png_set_compression_level(png_struct, options._z_compression);
-    png_set_compression_mem_level(png_struct, MAX_MEM_LEVEL);
-    png_set_compression_strategy(png_struct, options._z_strategy);
-    png_set_compression_window_bits(png_struct, 15);
-    png_set_compression_method(png_struct, Z_DEFLATED);
+    const buffer_t& scanlines(int png_filter) const {
+        auto found(std::find(_filters.begin(), _filters.end(), png_filter));
 
-    png_set_filter(png_struct, PNG_FILTER_TYPE_DEFAULT, options._png_filter);
-    png_set_packing(png_struct);
-    png_set_benign_errors(png_struct, 1);
+        return _filtered[found - _filters.begin()];
+    }
+};
 
-    png_set_IHDR(png_struct,
-                 png_info,
-                 image._width,
-                 image._height,
-                 image._depth,
-                 image._color_type,
-                 false, // interlacing
-                 PNG_COMPRESSION_TYPE_DEFAULT,
-                 PNG_FILTER_TYPE_DEFAULT);
+filter_cache_t::filter_cache_t(const image_t&                    image,
+                               const std::vector<one_options_t>& options_set) {
+    for (const auto& entry : options_set)
+        if (std::find(_filters.begin(), _filters.end(), entry._png_filter) == _filters.end())
+            _filters.push_back(entry._png_filter);
 
-    if (!image._color_table.empty()) {
-        std::vector<png_color> ctable;
-        std::vector<png_byte>  atable;
-        bool                   uses_alpha{false};
+    _filtered.resize(_filters.size());
 
-        for (const auto& entry : image._color_table) {
-            ctable.push_back({entry._r, entry._g, entry._b});
-            atable.push_back(entry._a);
+    tbb::parallel_for<std::size_t>(0, _filters.size(), 1, [&](std::size_t i) {
+        _filtered[i] = filter_image(image, _filters[i]);
+    });
+}
 
-            if (entry._a != 255)
-                uses_alpha = true;
-        }
+/**************************************************************************************************/
+// Fully encodes every candidate and returns the smallest result.
+bufferstream_t best_encode(const image_t&                    image,
+                           const filter_cache_t&             cache,
+                           const std::vector<one_options_t>& options_set) {
+    // with nothing to compare against, spread the one encode across the cores instead.
+    if (options_set.size() == 1) {
+        const auto& options(options_set.front());
 
-        png_set_PLTE(png_struct, png_info, ctable.data(), static_cast<int>(ctable.size()));
+        return encode_filtered_parallel(image,
+                                        cache.scanlines(options._png_filter),
+                                        {options._z_compression, options._z_strategy});
+    }
 
-        if (uses_alpha) {
-            png_color_16 npi{0}; // ???
+    std::atomic<std::size_t> best_size{std::numeric_limits<std::size_t>::max()};
+    bufferstream_t           best_stream;
+    std::mutex               mutex;
 
-            png_set_tRNS(png_struct,
-                         png_info,
-                         atable.data(),
-                         static_cast<int>(atable.size()),
-                         &npi);
+    tbb::parallel_for_each(options_set, [&](const auto& options) {
+        bufferstream_t stream(encode_filtered(image,
+                                              cache.scanlines(options._png_filter),
+                                              {options._z_compression, options._z_strategy},
+                                              best_size));
+
+        // an empty stream is a trial that was abandoned as a loser.
+        // check before we lock to make sure locking is necessary.
+        if (stream.empty() || stream.size() >= best_size) {
+            recycle_stream(std::move(stream));
+            return;
         }
-    }
 
-    png_write_info(png_struct, png_info);
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // check again now that we've got the lock.
+        if (stream.size() >= best_size) {
+            lock.unlock();
+            recycle_stream(std::move(stream));
+            return;
+        }
 
-    png_write_image(png_struct, const_cast<png_bytepp>(image._rows.data()));
+        best_size = stream.size();
+        std::swap(best_stream, stream);
 
-    png_write_end(png_struct, png_info);
+        lock.unlock();
 
-    png_destroy_write_struct(&png_struct, &png_info);
+        // the previous best is a loser now
+        recycle_stream(std::move(stream));
+    });
 
-    return stream;
+    return best_stream;
 }
 
 /**************************************************************************************************/
+// Gathers `rows` rows of filtered scanlines from evenly spaced horizontal strips of the image.
+buffer_t sample_scanlines(const buffer_t& filtered, std::size_t height, std::size_t rows) {
+    constexpr std::size_t strip_count_k{4};
 
-const auto& mid_options() {
-    static std::vector<one_options_t> value_s{{0, Z_DEFAULT_STRATEGY, PNG_FILTER_NONE},
-                                              {4, Z_HUFFMAN_ONLY, PNG_ALL_FILTERS},
-                                              {6, Z_DEFAULT_STRATEGY, PNG_FILTER_NONE},
-                                              {6, Z_DEFAULT_STRATEGY, PNG_FILTER_SUB},
-                                              {6, Z_FILTERED, PNG_ALL_FILTERS},
-                                              {9, Z_DEFAULT_STRATEGY, PNG_FILTER_NONE},
-                                              {9, Z_DEFAULT_STRATEGY, PNG_FILTER_SUB},
-                                              {9, Z_DEFAULT_STRATEGY, PNG_ALL_FILTERS},
-                                              {9, Z_FILTERED, PNG_FILTER_NONE},
-                                              {9, Z_FILTERED, PNG_FILTER_SUB},
-                                              {9, Z_FILTERED, PNG_ALL_FILTERS}};
+    const std::size_t stride(filtered.size() / height);
+    const std::size_t strip_count(std::min(strip_count_k, rows));
+    const std::size_t strip_rows((rows + strip_count - 1) / strip_count);
+    buffer_t          result(strip_count * strip_rows * stride);
+    auto              dst(result.data());
 
-    return value_s;
+    for (std::size_t i(0); i < strip_count; ++i) {
+        std::size_t first_row(strip_count == 1 ? 0 : (height - strip_rows) * i / (strip_count - 1));
+        auto        src(filtered.data() + first_row * stride);
+
+        dst = std::copy(src, src + strip_rows * stride, dst);
+    }
+
+    return result;
 }
 
 /**************************************************************************************************/
+// Successive halving: every candidate is ranked on a small sample of the image, the better half
+// survives, and the sample doubles. This repeats until only a few finalists remain or the sample
+// would cover the whole image; the survivors are returned for a full encode.
+std::vector<one_options_t> halve_options(const image_t&             image,
+                                         const filter_cache_t&      cache,
+                                         std::vector<one_options_t> candidates) {
+    constexpr std::size_t finalist_count_k{4};
+    constexpr std::size_t min_sample_rows_k{16};
 
-auto max_options_init() {
-    std::vector<one_options_t> result;
+    const std::size_t height(image.height());
+    std::size_t       sample_rows(std::max(height / 32, min_sample_rows_k));
 
-    for (auto compression(Z_NO_COMPRESSION); compression <= Z_BEST_COMPRESSION; ++compression) {
-        for (auto strategy(Z_DEFAULT_STRATEGY); strategy <= Z_FIXED; ++strategy) {
-            for (const auto& filter : {PNG_FILTER_NONE,
-                                       PNG_FILTER_SUB,
-                                       PNG_FILTER_UP,
-                                       PNG_FILTER_AVG,
-                                       PNG_FILTER_PAETH}) {
-                result.push_back(one_options_t{compression, strategy, filter});
-            }
+    while (candidates.size() > finalist_count_k && sample_rows < height) {
+        std::vector<int>      filters;
+        std::vector<buffer_t> samples;
+
+        for (const auto& entry : candidates) {
+            if (std::find(filters.begin(), filters.end(), entry._png_filter) != filters.end())
+                continue;
+
+            filters.push_back(entry._png_filter);
+            samples.push_back(
+                sample_scanlines(cache.scanlines(entry._png_filter), height, sample_rows));
         }
-    }
 
-    return result;
-}
+        std::vector<std::size_t> sizes(candidates.size());
 
-/**************************************************************************************************/
+        tbb::parallel_for<std::size_t>(0, candidates.size(), 1, [&](std::size_t i) {
+            const auto& options(candidates[i]);
+            auto found(std::find(filters.begin(), filters.end(), options._png_filter));
+            const auto& sample(samples[found - filters.begin()]);
 
-const auto& max_options() {
-    static std::vector<one_options_t> value_s(max_options_init());
+            sizes[i] = deflated_size(sample.data(),
+                                     sample.size(),
+                                     {options._z_compression, options._z_strategy});
+        });
 
-    return value_s;
+        std::vector<std::size_t> order(candidates.size());
+
+        std::iota(order.begin(), order.end(), 0);
+
+        std::stable_sort(order.begin(), order.end(), [&](auto x, auto y) {
+            return sizes[x] < sizes[y];
+        });
+
+        std::vector<one_options_t> survivors;
+        std::size_t survivor_count(std::max(finalist_count_k, (candidates.size() + 1) / 2));
+
+        for (std::size_t i(0); i < survivor_count; ++i)
+            survivors.push_back(candidates[order[i]]);
+
+        candidates = std::move(survivors);
+        sample_rows *= 2;
+    }
+
+    return candidates;
 }
 
 /**************************************************************************************************/
 
-std::size_t png_saver_t::save(const image_t& image, const save_options_t& options) {
-    if (!_output)
-        png_error(nullptr, "file could not be opened for save");
-
+// Runs the search the options call for and returns the smallest PNG it found.
+bufferstream_t encode(const image_t& image, const save_options_t& options) {
     std::vector<one_options_t> solo(1,
                                     {
                                         options._one_z_compression,
@@ -424,38 +488,81 @@ std::size_t png_saver_t::save(const image_t& image, const save_options_t& option
         options._mode == save_mode::one ?
             solo :
             options._mode == save_mode::mid ?
-            mid_options() :
-            options._mode == save_mode::max ? max_options() : std::vector<one_options_t>();
+            mid_options(image) :
+            options._mode == save_mode::max || options._mode == save_mode::halving ?
+            max_options() :
+            std::vector<one_options_t>();
+
+    filter_cache_t cache(image, options_set);
+    bufferstream_t best_stream(
+        best_encode(image,
+                    cache,
+                    options._mode == save_mode::halving ? halve_options(image, cache, options_set) :
+                                                          options_set));
 
-    image_params_t           image_params(image);
-    std::atomic<std::size_t> best_size{std::numeric_limits<std::size_t>::max()};
-    bufferstream_t           best_stream;
-    std::mutex               mutex;
+    if (best_stream.empty())
+        throw std::runtime_error("Could not encode PNG");
 
-    tbb::parallel_for_each(options_set,
-                           [&image_params, &best_size, &best_stream, &mutex](const auto& options) {
-                               bufferstream_t stream(write_one(image_params, options));
+    return best_stream;
+}
 
-                               // check before we lock to make sure locking is necessary.
-                               if (stream.size() >= best_size)
-                                   return;
+/**************************************************************************************************/
 
-                               std::lock_guard<std::mutex> lock(mutex);
+std::size_t png_saver_t::save(const image_t& image, const save_options_t& options) {
+    if (!_output)
+        throw std::runtime_error("file could not be opened for save");
 
-                               // check again now that we've got the lock.
-                               if (stream.size() >= best_size)
-                                   return;
+    bufferstream_t stream(encode(image, options));
 
-                               best_size   = stream.size();
-                               best_stream = std::move(stream);
-                           });
+    _output.write(reinterpret_cast<const char*>(stream.data()), stream.size());
 
-    if (best_stream.empty())
-        throw std::runtime_error("Could not save PNG");
+    return stream.size();
+}
+
+/**************************************************************************************************/
+// bytes claimed against the save budget; see save_claim_t.
+class save_budget_t {
+    std::mutex              _mutex;
+    std::condition_variable _released;
+    std::size_t             _budget{std::size_t(256) << 20};
+    std::size_t             _claimed{0};
+
+public:
+    void claim(std::size_t bytes) {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _released.wait(lock, [&]() { return !_claimed || _claimed + bytes <= _budget; });
+
+        _claimed += bytes;
+    }
+
+    void release(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _claimed -= bytes;
+
+        _released.notify_all();
+    }
 
-    _output.write(reinterpret_cast<const char*>(best_stream.data()), best_stream.size());
+    void set(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(_mutex);
 
-    return best_stream.size();
+        _budget = bytes;
+
+        _released.notify_all();
+    }
+
+    void drain() {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _released.wait(lock, [&]() { return !_claimed; });
+    }
+};
+
+save_budget_t& save_budget() {
+    static save_budget_t budget_s;
+
+    return budget_s;
 }
 
 /**************************************************************************************************/
@@ -469,25 +576,93 @@ namespace pngpp {
 /**************************************************************************************************/
 
 image_t read_png(const path_t& path) {
-    png_reader_t reader(path);
+    file_view_t file(path);
+
+    return decode_png(file.data(), file.size());
+}
+
+/**************************************************************************************************/
+
+image_t decode_png(const std::uint8_t* data, std::size_t size) {
+    png_reader_t reader(data, size);
 
     return reader.read();
 }
 
 /**************************************************************************************************/
 
+buffer_t encode_png(const image_t& image, const save_options_t& options) {
+    return encode(image, options).release();
+}
+
+/**************************************************************************************************/
+
 future<std::size_t> save_png(const image_t&        image,
                              const path_t&         path,
                              const save_options_t& options) {
-    return async([_image = image, _path = path, _options = options]() {
-        png_saver_t saver(_path);
+    auto claim(std::make_shared<save_claim_t>(image));
 
-        return saver.save(_image, _options);
+    return async([_image = image, _path = path, _options = options, _claim = std::move(claim)]() {
+        return save_png_sync(_image, _path, _options);
     });
 }
 
 /**************************************************************************************************/
 
+std::size_t save_png_sync(const image_t& image, const path_t& path, const save_options_t& options) {
+    png_saver_t saver(path);
+
+    return saver.save(image, options);
+}
+
+/**************************************************************************************************/
+
+save_claim_t::save_claim_t(const image_t& image) : _bytes(image.rowbytes() * image.height()) {
+    save_budget().claim(_bytes);
+}
+
+/**************************************************************************************************/
+
+save_claim_t::~save_claim_t() {
+    save_budget().release(_bytes);
+}
+
+/**************************************************************************************************/
+
+void set_save_budget(std::size_t bytes) {
+    save_budget().set(bytes);
+}
+
+/**************************************************************************************************/
+
+void flush_saves() {
+    save_budget().drain();
+}
+
+/**************************************************************************************************/
+
+namespace detail {
+
+/**************************************************************************************************/
+
+void png_fail(png_structp, png_const_charp message) {
+    squawk(message);
+
+    throw std::runtime_error(message);
+}
+
+/**************************************************************************************************/
+
+void png_warn(png_structp, png_const_charp message) {
+    squawk(message);
+}
+
+/**************************************************************************************************/
+
+} // namespace detail
+
+/**************************************************************************************************/
+
 } // namespace pngpp
 
 /**************************************************************************************************/
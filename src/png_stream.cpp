@@ -0,0 +1,265 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+// identity
+#include <pngpp/png_stream.hpp>
+
+// stdc++
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// application
+#include <pngpp/png_errors.hpp>
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+png_row_reader_t::png_row_reader_t(const path_t& path) : _file(new file_view_t(path)) {
+    _first = _file->data();
+    _last  = _first + _file->size();
+
+    start();
+}
+
+/**************************************************************************************************/
+
+png_row_reader_t::png_row_reader_t(const std::uint8_t* data, std::size_t size)
+    : _first(data), _last(data + size) {
+    start();
+}
+
+/**************************************************************************************************/
+
+png_row_reader_t::~png_row_reader_t() {
+    png_destroy_read_struct(&_png_struct, &_png_info, nullptr);
+}
+
+/**************************************************************************************************/
+
+void png_row_reader_t::read_thunk(png_structp png, png_bytep buffer, png_size_t size) {
+    if (!png || !buffer)
+        png_error(png, "invalid pointer");
+
+    auto reader(static_cast<png_row_reader_t*>(png_get_io_ptr(png)));
+
+    if (!reader)
+        png_error(png, "invalid pointer");
+
+    if (size > static_cast<std::size_t>(reader->_last - reader->_first))
+        png_error(png, "read past end of data");
+
+    std::memcpy(buffer, reader->_first, size);
+
+    reader->_first += size;
+}
+
+/**************************************************************************************************/
+
+void png_row_reader_t::start() {
+    // png_fail() throws out of libpng, and a throwing constructor never reaches the destructor.
+    try {
+        _png_struct = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                             nullptr,
+                                             &detail::png_fail,
+                                             &detail::png_warn);
+
+        if (!_png_struct)
+            throw std::runtime_error("png_create_read_struct failed");
+
+        _png_info = png_create_info_struct(_png_struct);
+
+        if (!_png_info)
+            png_error(_png_struct, "png_create_info_struct failed");
+
+        png_set_read_fn(_png_struct, this, &png_row_reader_t::read_thunk);
+        png_set_crc_action(_png_struct, PNG_CRC_WARN_USE, PNG_CRC_WARN_USE);
+
+        png_read_info(_png_struct, _png_info);
+
+        if (png_get_interlace_type(_png_struct, _png_info) != PNG_INTERLACE_NONE)
+            png_error(_png_struct, "interlaced images cannot be read a row at a time");
+
+        png_byte depth(png_get_bit_depth(_png_struct, _png_info));
+        bool     has_trns(png_get_valid(_png_struct, _png_info, PNG_INFO_tRNS) != 0);
+
+        if (depth > 8) {
+            png_set_swap(_png_struct); // litte endian representation for channel data > 8bpp
+        }
+
+        if (has_trns) {
+            png_set_palette_to_rgb(_png_struct);
+            png_set_tRNS_to_alpha(_png_struct);
+        }
+
+        png_read_update_info(_png_struct, _png_info);
+
+        _width      = png_get_image_width(_png_struct, _png_info);
+        _height     = png_get_image_height(_png_struct, _png_info);
+        _depth      = png_get_bit_depth(_png_struct, _png_info);
+        _rowbytes   = png_get_rowbytes(_png_struct, _png_info);
+        _color_type = png_get_color_type(_png_struct, _png_info);
+
+        if (_color_type != PNG_COLOR_TYPE_PALETTE)
+            return;
+
+        png_colorp colors{nullptr};
+        int        color_count{0};
+
+        png_get_PLTE(_png_struct, _png_info, &colors, &color_count);
+
+        for (int i(0); i < color_count; ++i)
+            _color_table.push_back({colors[i].red, colors[i].green, colors[i].blue, 255});
+    } catch (...) {
+        png_destroy_read_struct(&_png_struct, &_png_info, nullptr);
+
+        throw;
+    }
+}
+
+/**************************************************************************************************/
+
+void png_row_reader_t::read_row(std::uint8_t* row) {
+    if (!remaining())
+        throw std::runtime_error("no rows left to read");
+
+    png_read_row(_png_struct, row, nullptr);
+
+    if (++_row == _height)
+        png_read_end(_png_struct, nullptr);
+}
+
+/**************************************************************************************************/
+
+png_row_writer_t::png_row_writer_t(const path_t&         path,
+                                   std::size_t           width,
+                                   std::size_t           height,
+                                   std::size_t           depth,
+                                   int                   color_type,
+                                   const color_table_t&  color_table,
+                                   const save_options_t& options)
+    : _output(path.string().c_str(), std::ios_base::out | std::ios_base::binary),
+      _height(height) {
+    if (!_output)
+        throw std::runtime_error("file could not be opened for save");
+
+    // as in png_row_reader_t::start(), nothing else would free the structs if this throws.
+    try {
+        _png_struct = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+                                              nullptr,
+                                              &detail::png_fail,
+                                              &detail::png_warn);
+
+        if (!_png_struct)
+            throw std::runtime_error("png_create_write_struct failed");
+
+        _png_info = png_create_info_struct(_png_struct);
+
+        if (!_png_info)
+            png_error(_png_struct, "png_create_info_struct failed");
+
+        png_set_write_fn(_png_struct,
+                         this,
+                         &png_row_writer_t::write_thunk,
+                         &png_row_writer_t::flush_thunk);
+
+        png_set_compression_level(_png_struct, options._one_z_compression);
+        png_set_compression_mem_level(_png_struct, MAX_MEM_LEVEL);
+        png_set_compression_strategy(_png_struct, options._one_z_strategy);
+        png_set_compression_window_bits(_png_struct, 15);
+        png_set_compression_method(_png_struct, Z_DEFLATED);
+
+        png_set_filter(_png_struct, PNG_FILTER_TYPE_DEFAULT, options._one_png_filter);
+        png_set_benign_errors(_png_struct, 1);
+
+        png_set_IHDR(_png_struct,
+                     _png_info,
+                     static_cast<png_uint_32>(width),
+                     static_cast<png_uint_32>(height),
+                     static_cast<int>(depth),
+                     color_type,
+                     PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT,
+                     PNG_FILTER_TYPE_DEFAULT);
+
+        std::vector<png_color> ctable;
+        std::vector<png_byte>  atable;
+        bool                   uses_alpha{false};
+
+        for (const auto& entry : color_table) {
+            ctable.push_back({entry._r, entry._g, entry._b});
+            atable.push_back(entry._a);
+
+            if (entry._a != 255)
+                uses_alpha = true;
+        }
+
+        if (!ctable.empty())
+            png_set_PLTE(_png_struct, _png_info, ctable.data(), static_cast<int>(ctable.size()));
+
+        if (uses_alpha)
+            png_set_tRNS(_png_struct,
+                         _png_info,
+                         atable.data(),
+                         static_cast<int>(atable.size()),
+                         nullptr);
+
+        png_write_info(_png_struct, _png_info);
+    } catch (...) {
+        png_destroy_write_struct(&_png_struct, &_png_info);
+
+        throw;
+    }
+}
+
+/**************************************************************************************************/
+
+png_row_writer_t::~png_row_writer_t() {
+    png_destroy_write_struct(&_png_struct, &_png_info);
+}
+
+/**************************************************************************************************/
+
+void png_row_writer_t::write_thunk(png_structp png, png_bytep buffer, png_size_t size) {
+    if (!png || !buffer)
+        png_error(png, "invalid pointer");
+
+    auto writer(static_cast<png_row_writer_t*>(png_get_io_ptr(png)));
+
+    if (!writer)
+        png_error(png, "invalid pointer");
+
+    writer->_output.write(reinterpret_cast<const char*>(buffer), size);
+}
+
+/**************************************************************************************************/
+
+void png_row_writer_t::flush_thunk(png_structp png) {
+    static_cast<png_row_writer_t*>(png_get_io_ptr(png))->_output.flush();
+}
+
+/**************************************************************************************************/
+
+void png_row_writer_t::write_row(const std::uint8_t* row) {
+    if (!remaining())
+        throw std::runtime_error("no rows left to write");
+
+    png_write_row(_png_struct, row);
+
+    if (++_row != _height)
+        return;
+
+    png_write_end(_png_struct, _png_info);
+
+    _output.flush();
+}
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
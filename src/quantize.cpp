@@ -0,0 +1,602 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+// identity
+#include <pngpp/quantize.hpp>
+
+// stdc++
+#include <algorithm>
+#include <limits>
+
+// tbb
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+// application
+#include <pngpp/histogram.hpp>
+#include <pngpp/simd.hpp>
+
+/**************************************************************************************************/
+
+using namespace pngpp;
+
+/**************************************************************************************************/
+
+namespace {
+
+/**************************************************************************************************/
+// each channel is cut into 8 slabs of 32 values, giving 8^4 cells.
+constexpr std::size_t cell_shift_k{5};
+constexpr std::size_t cell_bits_k{8 - cell_shift_k};
+constexpr std::size_t cell_levels_k{1 << cell_bits_k};
+constexpr std::size_t cell_count_k{cell_levels_k * cell_levels_k * cell_levels_k * cell_levels_k};
+
+// pixels per quantization task
+constexpr std::size_t quantize_grain_k{4096};
+
+/**************************************************************************************************/
+
+inline std::size_t cell_of(const rgba_t& c) {
+    return ((c._r >> cell_shift_k) << (3 * cell_bits_k)) |
+           ((c._g >> cell_shift_k) << (2 * cell_bits_k)) | ((c._b >> cell_shift_k) << cell_bits_k) |
+           (c._a >> cell_shift_k);
+}
+
+/**************************************************************************************************/
+
+struct candidate_t {
+    std::int32_t  _min_sq_d; // squared distance from the entry to the nearest point of the cell
+    std::uint32_t _index;
+};
+
+/**************************************************************************************************/
+// Padding colors sit far enough outside the channel range to lose to any real color, and their
+// bound ends a search as soon as one is reached.
+constexpr std::int16_t  pad_value_k{1024};
+constexpr std::int32_t  pad_bound_k{std::numeric_limits<std::int32_t>::max()};
+constexpr std::uint32_t pad_index_k{std::numeric_limits<std::int32_t>::max()};
+
+typedef std::pair<std::size_t, std::int64_t> nearest_t;
+
+struct soa_view_t {
+    const std::int16_t*  _rg;
+    const std::int16_t*  _ba;
+    const std::int32_t*  _bound;
+    const std::uint32_t* _index;
+};
+
+typedef nearest_t (*nearest_kernel_t)(const soa_view_t& colors,
+                                      std::size_t       first,
+                                      std::size_t       last,
+                                      const rgba_t&     c);
+
+typedef nearest_two_t (*nearest_two_kernel_t)(const soa_view_t& colors,
+                                              std::size_t       count,
+                                              const rgba_t&     c);
+
+// no real color is this far from any query; anything farther is padding.
+constexpr std::int32_t max_sq_d_k{4 * 255 * 255};
+
+/**************************************************************************************************/
+
+nearest_t nearest_scalar(const soa_view_t& colors,
+                         std::size_t       first,
+                         std::size_t       last,
+                         const rgba_t&     c) {
+    std::size_t  index{0};
+    std::int64_t min_error{std::numeric_limits<std::int64_t>::max()};
+
+    for (; first != last; ++first) {
+        // the rest are at least this far away; equal ones may still tie on a lower index.
+        if (colors._bound[first] > min_error)
+            break;
+
+        const std::int16_t* rg(colors._rg + 2 * first);
+        const std::int16_t* ba(colors._ba + 2 * first);
+        std::int64_t        error(sq_distance(c._r, rg[0]) + sq_distance(c._g, rg[1]) +
+                           sq_distance(c._b, ba[0]) + sq_distance(c._a, ba[1]));
+
+        if (error > min_error || (error == min_error && colors._index[first] > index))
+            continue;
+
+        index     = colors._index[first];
+        min_error = error;
+    }
+
+    return nearest_t(index, min_error);
+}
+
+/**************************************************************************************************/
+
+nearest_two_t nearest_two_scalar(const soa_view_t& colors, std::size_t count, const rgba_t& c) {
+    nearest_two_t result{0,
+                         std::numeric_limits<std::int64_t>::max(),
+                         std::numeric_limits<std::int64_t>::max()};
+
+    for (std::size_t i(0); i < count && colors._index[i] != pad_index_k; ++i) {
+        const std::int16_t* rg(colors._rg + 2 * i);
+        const std::int16_t* ba(colors._ba + 2 * i);
+        std::int64_t        error(sq_distance(c._r, rg[0]) + sq_distance(c._g, rg[1]) +
+                           sq_distance(c._b, ba[0]) + sq_distance(c._a, ba[1]));
+
+        if (error < result._sq_d || (error == result._sq_d && colors._index[i] < result._index)) {
+            result._second_sq_d = result._sq_d;
+            result._sq_d        = error;
+            result._index       = colors._index[i];
+        } else {
+            result._second_sq_d = std::min(result._second_sq_d, error);
+        }
+    }
+
+    return result;
+}
+
+/**************************************************************************************************/
+#if PNGPP_X86_DISPATCH
+/**************************************************************************************************/
+// every lane of the result holds the smallest lane of x
+__attribute__((target("avx2"))) inline __m256i broadcast_min(__m256i x) {
+    x = _mm256_min_epi32(x, _mm256_permute2x128_si256(x, x, 1));
+    x = _mm256_min_epi32(x, _mm256_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+    x = _mm256_min_epi32(x, _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return x;
+}
+
+/**************************************************************************************************/
+// Eight colors per step: the interleaved 16-bit channel pairs make each squared distance two
+// multiply-adds. Each lane keeps its own best (distance, index) with the same tie rule as the
+// scalar walk; the lanes are reduced at the end.
+
+__attribute__((target("avx2"))) nearest_t nearest_avx2(const soa_view_t& colors,
+                                                       std::size_t       first,
+                                                       std::size_t       last,
+                                                       const rgba_t&     c) {
+    if (first == last)
+        return nearest_t(0, std::numeric_limits<std::int64_t>::max());
+
+    const __m256i rg(_mm256_set1_epi32((c._g << 16) | c._r));
+    const __m256i ba(_mm256_set1_epi32((c._a << 16) | c._b));
+    __m256i       best_d(_mm256_set1_epi32(pad_bound_k));
+    __m256i       best_i(_mm256_set1_epi32(pad_bound_k));
+    std::int32_t  min_error(pad_bound_k);
+
+    for (; first != last; first += soa_block_k) {
+        // blocks are in bound order, and a block's first bound is its smallest.
+        if (colors._bound[first] > min_error)
+            break;
+
+        __m256i d_rg(_mm256_sub_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors._rg + 2 * first)), rg));
+        __m256i d_ba(_mm256_sub_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors._ba + 2 * first)), ba));
+        __m256i d(_mm256_add_epi32(_mm256_madd_epi16(d_rg, d_rg), _mm256_madd_epi16(d_ba, d_ba)));
+        __m256i i(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors._index + first)));
+        __m256i better(_mm256_or_si256(_mm256_cmpgt_epi32(best_d, d),
+                                       _mm256_and_si256(_mm256_cmpeq_epi32(best_d, d),
+                                                        _mm256_cmpgt_epi32(best_i, i))));
+
+        best_d    = _mm256_blendv_epi8(best_d, d, better);
+        best_i    = _mm256_blendv_epi8(best_i, i, better);
+        min_error = _mm256_cvtsi256_si32(broadcast_min(best_d));
+    }
+
+    __m256i min_d(_mm256_set1_epi32(min_error));
+    __m256i ties(_mm256_blendv_epi8(_mm256_set1_epi32(pad_bound_k),
+                                    best_i,
+                                    _mm256_cmpeq_epi32(best_d, min_d)));
+
+    return nearest_t(_mm256_cvtsi256_si32(broadcast_min(ties)), min_error);
+}
+
+/**************************************************************************************************/
+// As nearest_avx2, but each lane also keeps the runner-up to its best. The overall runner-up is
+// the smallest of those and of the bests of the lanes that did not win.
+
+__attribute__((target("avx2"))) nearest_two_t nearest_two_avx2(const soa_view_t& colors,
+                                                               std::size_t       count,
+                                                               const rgba_t&     c) {
+    const __m256i rg(_mm256_set1_epi32((c._g << 16) | c._r));
+    const __m256i ba(_mm256_set1_epi32((c._a << 16) | c._b));
+    const __m256i none(_mm256_set1_epi32(pad_bound_k));
+    __m256i       best_d(none);
+    __m256i       best_i(none);
+    __m256i       second_d(none);
+
+    for (std::size_t first(0); first != count; first += soa_block_k) {
+        __m256i d_rg(_mm256_sub_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors._rg + 2 * first)), rg));
+        __m256i d_ba(_mm256_sub_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors._ba + 2 * first)), ba));
+        __m256i d(_mm256_add_epi32(_mm256_madd_epi16(d_rg, d_rg), _mm256_madd_epi16(d_ba, d_ba)));
+        __m256i i(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(colors._index + first)));
+        __m256i better(_mm256_or_si256(_mm256_cmpgt_epi32(best_d, d),
+                                       _mm256_and_si256(_mm256_cmpeq_epi32(best_d, d),
+                                                        _mm256_cmpgt_epi32(best_i, i))));
+
+        second_d = _mm256_blendv_epi8(_mm256_min_epi32(second_d, d), best_d, better);
+        best_d   = _mm256_blendv_epi8(best_d, d, better);
+        best_i   = _mm256_blendv_epi8(best_i, i, better);
+    }
+
+    __m256i min_d(broadcast_min(best_d));
+    __m256i ties(_mm256_blendv_epi8(none, best_i, _mm256_cmpeq_epi32(best_d, min_d)));
+    __m256i index(broadcast_min(ties));
+    __m256i winner(_mm256_and_si256(_mm256_cmpeq_epi32(best_d, min_d),
+                                    _mm256_cmpeq_epi32(best_i, index)));
+    __m256i others(_mm256_blendv_epi8(best_d, none, winner));
+    __m256i second(broadcast_min(_mm256_min_epi32(second_d, others)));
+
+    nearest_two_t result{0,
+                         std::numeric_limits<std::int64_t>::max(),
+                         std::numeric_limits<std::int64_t>::max()};
+    std::int32_t  sq_d(_mm256_cvtsi256_si32(min_d));
+    std::int32_t  second_sq_d(_mm256_cvtsi256_si32(second));
+
+    if (sq_d <= max_sq_d_k) {
+        result._index = static_cast<std::size_t>(_mm256_cvtsi256_si32(index));
+        result._sq_d  = sq_d;
+    }
+
+    if (second_sq_d <= max_sq_d_k)
+        result._second_sq_d = second_sq_d;
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+nearest_kernel_t select_nearest() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return &nearest_avx2;
+
+    return &nearest_scalar;
+}
+
+nearest_two_kernel_t select_nearest_two() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return &nearest_two_avx2;
+
+    return &nearest_two_scalar;
+}
+
+/**************************************************************************************************/
+#else
+/**************************************************************************************************/
+
+nearest_kernel_t select_nearest() {
+    return &nearest_scalar;
+}
+
+nearest_two_kernel_t select_nearest_two() {
+    return &nearest_two_scalar;
+}
+
+/**************************************************************************************************/
+#endif
+/**************************************************************************************************/
+// squared distances from `value` to the nearest and farthest points of the slab [lo, hi]
+inline std::pair<std::int32_t, std::int32_t> slab_sq_d(std::int32_t value,
+                                                       std::int32_t lo,
+                                                       std::int32_t hi) {
+    std::int32_t near(value < lo ? lo - value : value > hi ? value - hi : 0);
+    std::int32_t far(std::max(value - lo, hi - value));
+
+    return std::make_pair(near * near, far * far);
+}
+
+/**************************************************************************************************/
+
+// blank index and error images shaped like `source` (an image_t or a unique_colors_t)
+template <typename T>
+std::pair<image_t, image_t> make_quantization_images(const T& source) {
+    auto width(source.width());
+    auto height(source.height());
+    auto depth(source.depth());
+
+    return std::make_pair(image_t(width, height, depth, width, PNG_COLOR_TYPE_PALETTE),
+                          image_t(width, height, depth, width, PNG_COLOR_TYPE_PALETTE));
+}
+
+/**************************************************************************************************/
+
+} // namespace
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+soa_colors_t::soa_colors_t(const color_table_t& table) {
+    const auto count(table.size());
+
+    reserve(count + soa_block_k);
+
+    for (std::size_t i(0); i < count; ++i)
+        push_back(table[i], static_cast<std::uint32_t>(i));
+
+    pad();
+}
+
+/**************************************************************************************************/
+
+void soa_colors_t::reserve(std::size_t n) {
+    _rg.reserve(2 * n);
+    _ba.reserve(2 * n);
+    _bound.reserve(n);
+    _index.reserve(n);
+}
+
+/**************************************************************************************************/
+
+void soa_colors_t::push_back(const rgba_t& c, std::uint32_t index, std::int32_t bound) {
+    _rg.push_back(c._r);
+    _rg.push_back(c._g);
+    _ba.push_back(c._b);
+    _ba.push_back(c._a);
+    _bound.push_back(bound);
+    _index.push_back(index);
+}
+
+/**************************************************************************************************/
+
+void soa_colors_t::pad() {
+    while (size() % soa_block_k) {
+        _rg.insert(_rg.end(), 2, pad_value_k);
+        _ba.insert(_ba.end(), 2, pad_value_k);
+        _bound.push_back(pad_bound_k);
+        _index.push_back(pad_index_k);
+    }
+}
+
+/**************************************************************************************************/
+
+std::pair<std::size_t, std::int64_t> soa_colors_t::nearest(const rgba_t& c,
+                                                           std::size_t   first,
+                                                           std::size_t   last) const {
+    static const nearest_kernel_t kernel_s(select_nearest());
+    const soa_view_t              view{_rg.data(), _ba.data(), _bound.data(), _index.data()};
+
+    return kernel_s(view, first, last, c);
+}
+
+/**************************************************************************************************/
+
+nearest_two_t soa_colors_t::nearest_two(const rgba_t& c) const {
+    static const nearest_two_kernel_t kernel_s(select_nearest_two());
+    const soa_view_t                  view{_rg.data(), _ba.data(), _bound.data(), _index.data()};
+
+    return kernel_s(view, size(), c);
+}
+
+/**************************************************************************************************/
+
+palette_index_t::palette_index_t(color_table_t table)
+    : _table(std::move(table)), _cells(cell_count_k + 1, 0) {
+    const std::size_t                     count(_table.size());
+    std::vector<std::vector<candidate_t>> cells(cell_count_k);
+
+    if (!count)
+        return;
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, cell_count_k), [&](const auto& range) {
+        for (std::size_t cell(range.begin()); cell != range.end(); ++cell) {
+            std::int32_t lo[4];
+            std::int32_t hi[4];
+
+            for (std::size_t i(0); i < 4; ++i) {
+                std::size_t level((cell >> (cell_bits_k * (3 - i))) & (cell_levels_k - 1));
+
+                lo[i] = static_cast<std::int32_t>(level << cell_shift_k);
+                hi[i] = lo[i] + (1 << cell_shift_k) - 1;
+            }
+
+            auto&        candidates(cells[cell]);
+            std::int32_t bound(std::numeric_limits<std::int32_t>::max());
+
+            candidates.resize(count);
+
+            for (std::size_t j(0); j < count; ++j) {
+                const auto&  entry(_table[j]);
+                std::int32_t value[4] = {entry._r, entry._g, entry._b, entry._a};
+                std::int32_t near{0};
+                std::int32_t far{0};
+
+                for (std::size_t i(0); i < 4; ++i) {
+                    auto d(slab_sq_d(value[i], lo[i], hi[i]));
+
+                    near += d.first;
+                    far += d.second;
+                }
+
+                candidates[j] = candidate_t{near, static_cast<std::uint32_t>(j)};
+                bound = std::min(bound, far);
+            }
+
+            // every color in the cell lies within `bound` of some entry, so an entry farther than
+            // that from the whole cell can never be the nearest.
+            candidates.erase(std::remove_if(candidates.begin(),
+                                            candidates.end(),
+                                            [bound](const auto& x) { return x._min_sq_d > bound; }),
+                             candidates.end());
+
+            std::sort(candidates.begin(), candidates.end(), [](const auto& x, const auto& y) {
+                return x._min_sq_d < y._min_sq_d ||
+                       (x._min_sq_d == y._min_sq_d && x._index < y._index);
+            });
+        }
+    });
+
+    std::size_t total(0);
+
+    for (const auto& candidates : cells)
+        total += candidates.size() + soa_block_k;
+
+    _candidates.reserve(total);
+
+    for (std::size_t cell(0); cell < cell_count_k; ++cell) {
+        _cells[cell] = _candidates.size();
+
+        for (const auto& candidate : cells[cell])
+            _candidates.push_back(_table[candidate._index], candidate._index, candidate._min_sq_d);
+
+        _candidates.pad();
+    }
+
+    _cells[cell_count_k] = _candidates.size();
+}
+
+/**************************************************************************************************/
+
+std::pair<std::size_t, std::int64_t> palette_index_t::nearest(const rgba_t& c) const {
+    std::size_t cell(cell_of(c));
+
+    return _candidates.nearest(c, _cells[cell], _cells[cell + 1]);
+}
+
+/**************************************************************************************************/
+
+color_table_t make_grad_table() {
+    // grayscale gradient color table from black to white. It might be better to
+    // make this e.g., a green or yellow gradient instead, to ease visibility in
+    // the dark range.
+    std::size_t   count(PNG_MAX_PALETTE_LENGTH);
+    color_table_t result(count);
+
+    for (std::size_t i(0); i < count; ++i) {
+        result[i]._r = i;
+        result[i]._g = i;
+        result[i]._b = i;
+        result[i]._a = 255;
+    }
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+std::pair<std::size_t, double> quantize(const rgba_t& c, const color_table_t& table) {
+    std::size_t  index{0};
+    std::int64_t min_error{std::numeric_limits<std::int64_t>::max()};
+    std::size_t  count(table.size());
+
+    for (std::size_t i(0); i < count; ++i) {
+        std::int64_t error(sq_distance(c, table[i]));
+
+        if (error >= min_error)
+            continue;
+
+        index     = i;
+        min_error = error;
+
+        // exact match; no need to keep looking
+        if (min_error == 0)
+            break;
+    }
+
+    return std::make_pair(index, std::sqrt(min_error));
+}
+
+/**************************************************************************************************/
+
+quantization_t quantize(const image_t& image, color_table_t color_table) {
+    quantization_t  result(make_quantization_images(image));
+    auto            dst(result.first.begin());
+    auto            err_dst(result.second.begin());
+    palette_index_t index(std::move(color_table));
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, image.area(), quantize_grain_k),
+                      [&](const auto& range) {
+                          for (std::size_t i(range.begin()); i != range.end(); ++i) {
+                              auto q(index.nearest(image.pixel<std::uint8_t>(i)));
+
+                              dst[i]     = q.first;
+                              err_dst[i] = quantization_error(q.second);
+                          }
+                      });
+
+    result.first.set_color_table(index.table());
+    result.second.set_color_table(make_grad_table());
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+unique_colors_t::unique_colors_t(const image_t& image)
+    : _width(image.width()), _height(image.height()), _depth(image.depth()),
+      _pixels(image.area()) {
+    color_histogram_t          histogram(color_histogram(image));
+    auto                       sorted(histogram.sorted());
+    const auto                 count(sorted.size());
+    std::vector<std::uint32_t> rank(histogram.capacity()); // by histogram slot
+
+    _colors.resize(count);
+    _counts.resize(count);
+
+    for (std::size_t i(0); i < count; ++i) {
+        _colors[i] = sorted[i].first;
+        _counts[i] = sorted[i].second;
+
+        rank[histogram.slot(pack_rgba(_colors[i]))] = static_cast<std::uint32_t>(i);
+    }
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, _pixels.size(), quantize_grain_k),
+                      [&](const auto& range) {
+                          for (std::size_t i(range.begin()); i != range.end(); ++i) {
+                              auto key(pack_rgba(image.pixel<std::uint8_t>(i)));
+
+                              _pixels[i] = rank[histogram.slot(key)];
+                          }
+                      });
+}
+
+/**************************************************************************************************/
+
+quantization_t quantize(const unique_colors_t& colors, color_table_t color_table) {
+    quantization_t  result(make_quantization_images(colors));
+    auto            dst(result.first.begin());
+    auto            err_dst(result.second.begin());
+    palette_index_t index(std::move(color_table));
+    const auto&     unique(colors.colors());
+    const auto&     pixels(colors.pixels());
+    const auto      count(unique.size());
+
+    std::vector<std::uint8_t> entries(count);
+    std::vector<std::uint8_t> errors(count);
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, count, quantize_grain_k),
+                      [&](const auto& range) {
+                          for (std::size_t i(range.begin()); i != range.end(); ++i) {
+                              auto q(index.nearest(unique[i]));
+
+                              entries[i] = q.first;
+                              errors[i]  = quantization_error(q.second);
+                          }
+                      });
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, pixels.size(), quantize_grain_k),
+                      [&](const auto& range) {
+                          for (std::size_t i(range.begin()); i != range.end(); ++i) {
+                              dst[i]     = entries[pixels[i]];
+                              err_dst[i] = errors[pixels[i]];
+                          }
+                      });
+
+    result.first.set_color_table(index.table());
+    result.second.set_color_table(make_grad_table());
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
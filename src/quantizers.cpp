@@ -0,0 +1,575 @@
+/**************************************************************************************************/
+// PNGpp copyright 2017 Foster Brereton. See LICENSE.txt for license details.
+/**************************************************************************************************/
+
+// identity
+#include <pngpp/quantizers.hpp>
+
+// stdc++
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+// application
+#include <pngpp/histogram.hpp>
+
+/**************************************************************************************************/
+
+using namespace pngpp;
+
+/**************************************************************************************************/
+
+namespace {
+
+/**************************************************************************************************/
+
+constexpr std::size_t channels_k{4};
+
+inline std::uint8_t channel(const rgba_t& c, std::size_t k) {
+    switch (k) {
+        case 0:
+            return c._r;
+        case 1:
+            return c._g;
+        case 2:
+            return c._b;
+        default:
+            return c._a;
+    }
+}
+
+/**************************************************************************************************/
+// Weight, per-channel sums and the sum of squared magnitudes of a set of colors: enough to give
+// its mean and its squared error about the mean. Sums are exact integers, so moments can be
+// subtracted from one another.
+struct moments_t {
+    std::int64_t _w{0};
+    std::int64_t _sum[channels_k]{};
+    std::int64_t _sq{0};
+
+    void add(const rgba_t& c, std::int64_t w) {
+        _w += w;
+
+        for (std::size_t k(0); k < channels_k; ++k) {
+            std::int64_t x(channel(c, k));
+
+            _sum[k] += w * x;
+            _sq += w * x * x;
+        }
+    }
+
+    moments_t& operator+=(const moments_t& x) {
+        _w += x._w;
+
+        for (std::size_t k(0); k < channels_k; ++k)
+            _sum[k] += x._sum[k];
+
+        _sq += x._sq;
+
+        return *this;
+    }
+
+    moments_t& operator-=(const moments_t& x) {
+        _w -= x._w;
+
+        for (std::size_t k(0); k < channels_k; ++k)
+            _sum[k] -= x._sum[k];
+
+        _sq -= x._sq;
+
+        return *this;
+    }
+
+    // sum of squared means, scaled by the weight: what splitting off this set removes from the
+    // squared error of the whole
+    double gain() const {
+        double result(0);
+
+        for (std::size_t k(0); k < channels_k; ++k)
+            result += double(_sum[k]) * _sum[k];
+
+        return _w ? result / _w : 0;
+    }
+
+    // squared error about the mean
+    double error() const {
+        return _sq - gain();
+    }
+
+    rgba_t mean() const {
+        auto avg = [&](std::size_t k) {
+            return static_cast<std::uint8_t>(std::lround(double(_sum[k]) / _w));
+        };
+
+        return rgba_t{avg(0), avg(1), avg(2), avg(3)};
+    }
+};
+
+/**************************************************************************************************/
+// the index of the entry of `v` with the highest error, or v.size() if none has any
+template <typename T>
+std::size_t worst(const std::vector<T>& v) {
+    std::size_t result(v.size());
+    double      max(0);
+
+    for (std::size_t i(0); i < v.size(); ++i) {
+        if (v[i]._error > max) {
+            max    = v[i]._error;
+            result = i;
+        }
+    }
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+struct median_cut_box_t {
+    std::size_t _first;
+    std::size_t _last;
+    moments_t   _moments;
+    double      _error;
+};
+
+/**************************************************************************************************/
+// Gervautz-Purgathofer octree, extended to four channels. Level l of the tree branches on bit
+// (7 - l) of each channel. Leaves either sit at level 8 (one exact color) or are internal nodes
+// that have been folded.
+class octree_t {
+    static constexpr std::size_t   levels_k{8};
+    static constexpr std::size_t   children_k{16};
+    static constexpr std::uint32_t none_k{0};
+
+    struct node_t {
+        moments_t                             _moments;
+        std::array<std::uint32_t, children_k> _children;
+        bool                                  _leaf;
+    };
+
+    std::vector<node_t>                                  _nodes; // _nodes[0] is the root
+    std::vector<std::uint32_t>                           _free;
+    std::array<std::vector<std::uint32_t>, levels_k + 1> _reducible; // internal nodes by level
+    std::size_t                                          _leaves{0};
+
+    std::uint32_t make_node(std::size_t level) {
+        std::uint32_t result;
+
+        if (_free.empty()) {
+            result = static_cast<std::uint32_t>(_nodes.size());
+
+            _nodes.emplace_back();
+        } else {
+            result = _free.back();
+
+            _free.pop_back();
+        }
+
+        node_t& node(_nodes[result]);
+
+        node._moments = moments_t();
+        node._children.fill(none_k);
+        node._leaf = level == levels_k;
+
+        if (node._leaf)
+            ++_leaves;
+        else
+            _reducible[level].push_back(result);
+
+        return result;
+    }
+
+    // folds the children of the most recently split node at the deepest level into it
+    void reduce() {
+        std::size_t level(levels_k);
+
+        while (_reducible[level].empty())
+            --level;
+
+        std::uint32_t index(_reducible[level].back());
+
+        _reducible[level].pop_back();
+
+        for (auto& child : _nodes[index]._children) {
+            if (child == none_k)
+                continue;
+
+            // every deeper node is a leaf, as their levels have nothing left to reduce
+            _nodes[index]._moments += _nodes[child]._moments;
+
+            _free.push_back(child);
+
+            child = none_k;
+
+            --_leaves;
+        }
+
+        _nodes[index]._leaf = true;
+
+        ++_leaves;
+    }
+
+public:
+    octree_t() {
+        make_node(0);
+    }
+
+    void add(const rgba_t& c, std::size_t count, std::size_t n) {
+        std::uint32_t index(0);
+
+        for (std::size_t level(0); !_nodes[index]._leaf; ++level) {
+            const std::size_t shift(levels_k - 1 - level);
+            const std::size_t child(((c._r >> shift) & 1) << 3 | ((c._g >> shift) & 1) << 2 |
+                                    ((c._b >> shift) & 1) << 1 | ((c._a >> shift) & 1));
+
+            if (_nodes[index]._children[child] == none_k) {
+                std::uint32_t made(make_node(level + 1));
+
+                _nodes[index]._children[child] = made;
+            }
+
+            index = _nodes[index]._children[child];
+        }
+
+        _nodes[index]._moments.add(c, count);
+
+        while (_leaves > n)
+            reduce();
+    }
+
+    color_table_t table() const {
+        color_table_t              result;
+        std::vector<std::uint32_t> stack(1, 0);
+
+        while (!stack.empty()) {
+            const node_t& node(_nodes[stack.back()]);
+
+            stack.pop_back();
+
+            if (node._leaf) {
+                result.push_back(node._moments.mean());
+
+                continue;
+            }
+
+            for (auto child : node._children)
+                if (child != none_k)
+                    stack.push_back(child);
+        }
+
+        return result;
+    }
+};
+
+// fill() takes its argument by reference, so the constant needs a definition (until C++17.)
+constexpr std::uint32_t octree_t::none_k;
+
+/**************************************************************************************************/
+// Cumulative moments of the colors binned on a grid, 5 bits per channel but 4 for alpha (keeping
+// the grid of an image with transparency to 33^3 * 17 cells.) Cell 0 of each axis is an empty
+// border so that a box can be given as (lo, hi]. Channels that never vary get a single cell,
+// which keeps the grid small for opaque images.
+class wu_grid_t {
+    std::array<std::size_t, channels_k> _side;
+    std::array<std::size_t, channels_k> _stride;
+    std::array<bool, channels_k>        _constant;
+    std::vector<moments_t>              _cells;
+
+    // bits dropped from channel k
+    static std::size_t shift(std::size_t k) {
+        return k == 3 ? 4 : 3;
+    }
+
+public:
+    typedef std::array<std::size_t, channels_k> corner_t;
+
+    struct box_t {
+        corner_t  _lo; // exclusive
+        corner_t  _hi; // inclusive
+        moments_t _moments;
+        double    _error;
+    };
+
+    wu_grid_t(const std::vector<rgba_t>& colors, const std::vector<std::size_t>& counts) {
+        std::size_t size(1);
+
+        for (std::size_t k(0); k < channels_k; ++k) {
+            _constant[k] = std::all_of(colors.begin(), colors.end(), [&](const rgba_t& c) {
+                return channel(c, k) == channel(colors.front(), k);
+            });
+            _side[k]     = _constant[k] ? 2 : (1 << (8 - shift(k))) + 1;
+            _stride[k]   = size;
+
+            size *= _side[k];
+        }
+
+        _cells.resize(size);
+
+        for (std::size_t i(0); i < colors.size(); ++i) {
+            corner_t cell;
+
+            for (std::size_t k(0); k < channels_k; ++k)
+                cell[k] = _constant[k] ? 1 : (channel(colors[i], k) >> shift(k)) + 1;
+
+            _cells[index(cell)].add(colors[i], counts[i]);
+        }
+
+        // prefix sums along each axis in turn make every cell the moments of the box (0, cell]
+        for (std::size_t k(0); k < channels_k; ++k) {
+            const std::size_t stride(_stride[k]);
+            const std::size_t span(stride * _side[k]);
+
+            for (std::size_t base(0); base < size; base += span)
+                for (std::size_t i(base + stride); i < base + span; ++i)
+                    _cells[i] += _cells[i - stride];
+        }
+    }
+
+    std::size_t index(const corner_t& cell) const {
+        std::size_t result(0);
+
+        for (std::size_t k(0); k < channels_k; ++k)
+            result += cell[k] * _stride[k];
+
+        return result;
+    }
+
+    // the moments of the colors in (lo, hi], by inclusion-exclusion over its 16 corners
+    moments_t volume(const corner_t& lo, const corner_t& hi) const {
+        moments_t result;
+
+        for (std::size_t mask(0); mask < (1 << channels_k); ++mask) {
+            corner_t    corner;
+            std::size_t lows(0);
+
+            for (std::size_t k(0); k < channels_k; ++k) {
+                bool low((mask >> k) & 1);
+
+                corner[k] = low ? lo[k] : hi[k];
+                lows += low;
+            }
+
+            if (lows % 2)
+                result -= _cells[index(corner)];
+            else
+                result += _cells[index(corner)];
+        }
+
+        return result;
+    }
+
+    box_t make_box(const corner_t& lo, const corner_t& hi) const {
+        box_t result{lo, hi, volume(lo, hi), 0};
+
+        result._error = result._moments.error();
+
+        return result;
+    }
+
+    box_t whole() const {
+        corner_t lo{};
+        corner_t hi;
+
+        for (std::size_t k(0); k < channels_k; ++k)
+            hi[k] = _side[k] - 1;
+
+        return make_box(lo, hi);
+    }
+
+    // Splits `box` where the two halves have the least squared error between them, putting the
+    // low half in `box` and returning the high half. Returns false if the box spans one cell.
+    bool cut(box_t& box, box_t& high) const {
+        double      best_gain(0);
+        std::size_t best_k(channels_k);
+        std::size_t best_at(0);
+
+        for (std::size_t k(0); k < channels_k; ++k) {
+            corner_t hi(box._hi);
+
+            for (std::size_t at(box._lo[k] + 1); at < box._hi[k]; ++at) {
+                hi[k] = at;
+
+                moments_t low(volume(box._lo, hi));
+                moments_t rest(box._moments);
+
+                rest -= low;
+
+                if (!low._w || !rest._w)
+                    continue;
+
+                double gain(low.gain() + rest.gain());
+
+                if (gain > best_gain) {
+                    best_gain = gain;
+                    best_k    = k;
+                    best_at   = at;
+                }
+            }
+        }
+
+        if (best_k == channels_k)
+            return false;
+
+        corner_t low_hi(box._hi);
+        corner_t high_lo(box._lo);
+
+        low_hi[best_k]  = best_at;
+        high_lo[best_k] = best_at;
+
+        high = make_box(high_lo, box._hi);
+        box  = make_box(box._lo, low_hi);
+
+        return true;
+    }
+};
+
+/**************************************************************************************************/
+
+} // namespace
+
+/**************************************************************************************************/
+
+namespace pngpp {
+
+/**************************************************************************************************/
+
+color_table_t median_cut(const std::vector<rgba_t>&      colors,
+                         const std::vector<std::size_t>& counts,
+                         std::size_t                     n) {
+    if (colors.empty() || !n)
+        return color_table_t();
+
+    std::vector<std::pair<rgba_t, std::size_t>> entries;
+
+    entries.reserve(colors.size());
+
+    for (std::size_t i(0); i < colors.size(); ++i)
+        entries.emplace_back(colors[i], counts[i]);
+
+    auto make_box = [&](std::size_t first, std::size_t last) {
+        median_cut_box_t result{first, last, moments_t(), 0};
+
+        for (std::size_t i(first); i < last; ++i)
+            result._moments.add(entries[i].first, entries[i].second);
+
+        result._error = result._moments.error();
+
+        return result;
+    };
+
+    std::vector<median_cut_box_t> boxes(1, make_box(0, entries.size()));
+
+    for (std::size_t i; boxes.size() < n && (i = worst(boxes)) != boxes.size();) {
+        median_cut_box_t& box(boxes[i]);
+        auto              first(entries.begin() + box._first);
+        auto              last(entries.begin() + box._last);
+        std::size_t       k(0);
+        int               longest(-1);
+
+        for (std::size_t j(0); j < channels_k; ++j) {
+            auto range(std::minmax_element(first, last, [&](const auto& x, const auto& y) {
+                return channel(x.first, j) < channel(y.first, j);
+            }));
+            int  side(channel(range.second->first, j) - channel(range.first->first, j));
+
+            if (side > longest) {
+                longest = side;
+                k       = j;
+            }
+        }
+
+        std::sort(first, last, [&](const auto& x, const auto& y) {
+            return channel(x.first, k) < channel(y.first, k);
+        });
+
+        // the first color past half the weight starts the high box; both keep at least one color
+        std::int64_t half(box._moments._w / 2);
+        std::int64_t weight(0);
+        std::size_t  split(box._first);
+
+        while (split < box._last - 1 && (weight += entries[split].second) <= half)
+            ++split;
+
+        split = std::max(split, box._first + 1);
+
+        median_cut_box_t high(make_box(split, box._last));
+
+        box = make_box(box._first, split);
+
+        boxes.push_back(high);
+    }
+
+    color_table_t result;
+
+    for (const auto& box : boxes)
+        result.push_back(box._moments.mean());
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+color_table_t octree(const std::vector<rgba_t>&      colors,
+                     const std::vector<std::size_t>& counts,
+                     std::size_t                     n) {
+    if (colors.empty() || !n)
+        return color_table_t();
+
+    octree_t tree;
+
+    for (std::size_t i(0); i < colors.size(); ++i)
+        tree.add(colors[i], counts[i], n);
+
+    return tree.table();
+}
+
+/**************************************************************************************************/
+
+color_table_t wu(const std::vector<rgba_t>&      colors,
+                 const std::vector<std::size_t>& counts,
+                 std::size_t                     n) {
+    if (colors.empty() || !n)
+        return color_table_t();
+
+    wu_grid_t                       grid(colors, counts);
+    std::vector<wu_grid_t::box_t>   boxes(1, grid.whole());
+
+    for (std::size_t i; boxes.size() < n && (i = worst(boxes)) != boxes.size();) {
+        wu_grid_t::box_t high;
+
+        if (grid.cut(boxes[i], high))
+            boxes.push_back(high);
+        else
+            boxes[i]._error = 0; // a single cell; it cannot be cut any further
+    }
+
+    color_table_t result;
+
+    for (const auto& box : boxes)
+        result.push_back(box._moments.mean());
+
+    return result;
+}
+
+/**************************************************************************************************/
+
+color_table_t make_color_table(quantizer_t quantizer, const image_t& image, std::size_t n) {
+    auto                     sorted(color_histogram(image).sorted());
+    std::vector<rgba_t>      colors;
+    std::vector<std::size_t> counts;
+
+    colors.reserve(sorted.size());
+    counts.reserve(sorted.size());
+
+    for (const auto& entry : sorted) {
+        colors.push_back(entry.first);
+        counts.push_back(entry.second);
+    }
+
+    return quantizer(colors, counts, n);
+}
+
+/**************************************************************************************************/
+
+} // namespace pngpp
+
+/**************************************************************************************************/
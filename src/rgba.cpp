@@ -5,9 +5,6 @@
 // identity
 #include <pngpp/rgba.hpp>
 
-// stdc++
-#include <array>
-
 /**************************************************************************************************/
 
 namespace pngpp {
@@ -17,73 +14,57 @@ namespace pngpp {
 namespace {
 
 /**************************************************************************************************/
+// fixdiv is defined by floating point math, and about a hundred of its results land on the low
+// side of an exact half, so no short integer formula reproduces it. The table is filled once at
+// static initialization, as a 64KB constant expression is beyond some compilers' limits.
 
-auto itof_g_init() {
-    std::array<double, 256> result;
-
-    for (std::size_t i(0); i < 256; ++i)
-        result[i] = i / 255.;
+struct fixdiv_table_t {
+    std::uint8_t _values[256 * 256 + 3]; // see fixdiv_table() for the padding
+};
 
-    return result;
-}
-
-const auto itof_g{itof_g_init()};
-
-/**************************************************************************************************/
-
-auto fixmul_g_init() {
-    std::array<double, 65536> result;
+fixdiv_table_t fixdiv_g_init() {
+    fixdiv_table_t result{};
 
     for (std::size_t y(0); y < 256; ++y) {
         auto fy{itof(y)};
         for (std::size_t x(0); x < 256; ++x) {
-            auto fx{itof(x)};
-            result[y * 256 + x] = ftoi(fx * fy);
+            result._values[y * 256 + x] = y <= x ? 255 : ftoi(itof(x) / fy);
         }
     }
 
     return result;
 }
 
-const auto fixmul_g{fixmul_g_init()};
+const fixdiv_table_t fixdiv_g{fixdiv_g_init()};
 
 /**************************************************************************************************/
 
-auto fixdiv_g_init() {
-    std::array<double, 65536> result;
+} // namespace
 
-    for (std::size_t y(0); y < 256; ++y) {
-        auto fy{itof(y)};
-        for (std::size_t x(0); x < 256; ++x) {
-            result[y * 256 + x] = y <= x ? 255 : ftoi(itof(x) / fy);
-        }
-    }
+/**************************************************************************************************/
 
-    return result;
+std::uint8_t fixdiv(std::uint8_t x, std::uint8_t y) {
+    return fixdiv_g._values[y * 256 + x];
 }
 
-const auto fixdiv_g{fixdiv_g_init()};
-
-/**************************************************************************************************/
-
-} // namespace
+const std::uint8_t* fixdiv_table() {
+    return fixdiv_g._values;
+}
 
 /**************************************************************************************************/
 
-std::uint8_t fixmul(std::uint8_t x, std::uint8_t y) {
-    return fixmul_g[y * 256 + x];
+void fixmul_n(const std::uint8_t* x, const std::uint8_t* y, std::uint8_t* result, std::size_t n) {
+    for (std::size_t i(0); i < n; ++i)
+        result[i] = fixmul(x[i], y[i]);
 }
 
-std::uint8_t fixdiv(std::uint8_t x, std::uint8_t y) {
-    return fixdiv_g[y * 256 + x];
+void fixdiv_n(const std::uint8_t* x, const std::uint8_t* y, std::uint8_t* result, std::size_t n) {
+    for (std::size_t i(0); i < n; ++i)
+        result[i] = fixdiv_g._values[y[i] * 256 + x[i]];
 }
 
 /**************************************************************************************************/
 
-double itof(std::uint8_t x) {
-    return itof_g[x];
-}
-
 std::uint8_t ftoi(double x) {
     return x >= 1 ? 255 : x <= 0 ? 0 : std::lround(x * 255);
 }